@@ -0,0 +1,229 @@
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// C++ side of mkSimDram in SimDram.bsv (bsim only)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint64_t page_bytes = 1ULL << 16;
+const char snapshot_magic[8] = {'S', 'I', 'M', 'D', 'R', 'A', 'M', '1'};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t bytes; // memory size
+    uint64_t page_bytes;
+    uint64_t page_num; // number of page records that follow
+};
+// each page record is the page index (uint64_t) followed by the page data
+
+struct SimDram {
+    uint8_t *base; // reserved for the whole memory, pages are mapped on touch
+    uint64_t bytes;
+    std::vector<uint8_t> touched; // pages that have been written
+    // snapshot files, fixed at init so saving needs no allocation
+    std::string save_path;
+    std::string save_tmp_path;
+};
+
+std::vector<SimDram*> drams;
+bool saved = false;
+
+bool writeAll(int fd, const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t*)buf;
+    while(n > 0) {
+        ssize_t r = write(fd, p, n);
+        if(r <= 0) {
+            return false;
+        }
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool readAll(int fd, void *buf, size_t n) {
+    uint8_t *p = (uint8_t*)buf;
+    while(n > 0) {
+        ssize_t r = read(fd, p, n);
+        if(r <= 0) {
+            return false;
+        }
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool isZeroPage(const uint8_t *p) {
+    const uint64_t *w = (const uint64_t*)p;
+    for(uint64_t i = 0; i < page_bytes / 8; i++) {
+        if(w[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// only uses syscalls, so it can be called from the signal handler
+bool save(const SimDram &d) {
+    int fd = open(d.save_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return false;
+    }
+    // zero pages are skipped, they read as 0 when loaded anyway
+    SnapshotHeader h;
+    memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+    h.bytes = d.bytes;
+    h.page_bytes = page_bytes;
+    h.page_num = 0;
+    for(uint64_t i = 0; i < d.touched.size(); i++) {
+        if(d.touched[i] && !isZeroPage(d.base + i * page_bytes)) {
+            h.page_num++;
+        }
+    }
+    bool ok = writeAll(fd, &h, sizeof(h));
+    for(uint64_t i = 0; ok && i < d.touched.size(); i++) {
+        const uint8_t *p = d.base + i * page_bytes;
+        if(d.touched[i] && !isZeroPage(p)) {
+            ok = writeAll(fd, &i, sizeof(i)) && writeAll(fd, p, page_bytes);
+        }
+    }
+    ok = close(fd) == 0 && ok;
+    return ok && rename(d.save_tmp_path.c_str(), d.save_path.c_str()) == 0;
+}
+
+void saveAll() {
+    if(saved) {
+        return;
+    }
+    saved = true;
+    for(size_t i = 0; i < drams.size(); i++) {
+        if(!save(*drams[i])) {
+            static const char msg[] = "ERROR: SimDram failed to save snapshot\n";
+            ssize_t r = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+            (void)r;
+        }
+    }
+}
+
+void saveOnSignal(int sig) {
+    saveAll();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void load(SimDram &d, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "WARNING: SimDram snapshot %s not found, start with empty memory\n", path);
+        return;
+    }
+    SnapshotHeader h;
+    if(!readAll(fd, &h, sizeof(h)) || memcmp(h.magic, snapshot_magic, sizeof(h.magic)) != 0 ||
+       h.bytes != d.bytes || h.page_bytes != page_bytes) {
+        fprintf(stderr, "ERROR: SimDram snapshot %s does not match memory of %llu bytes\n",
+                path, (long long unsigned)d.bytes);
+        exit(-1);
+    }
+    for(uint64_t n = 0; n < h.page_num; n++) {
+        uint64_t i;
+        if(!readAll(fd, &i, sizeof(i)) || i >= d.touched.size() ||
+           !readAll(fd, d.base + i * page_bytes, page_bytes)) {
+            fprintf(stderr, "ERROR: SimDram snapshot %s is corrupted at page %llu\n",
+                    path, (long long unsigned)n);
+            exit(-1);
+        }
+        d.touched[i] = 1;
+    }
+    close(fd);
+    fprintf(stderr, "INFO: SimDram %d loaded %llu pages from %s\n",
+            int(drams.size()), (long long unsigned)h.page_num, path);
+}
+
+} // namespace
+
+extern "C" {
+
+unsigned int simDramInit(unsigned long long bytes) {
+    SimDram *d = new SimDram;
+    d->bytes = bytes;
+    uint64_t page_num = (bytes + page_bytes - 1) / page_bytes;
+    // physical pages are only allocated on first touch
+    void *p = mmap(0, page_num * page_bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED) {
+        fprintf(stderr, "ERROR: SimDram cannot reserve %llu bytes\n", (long long unsigned)bytes);
+        exit(-1);
+    }
+    d->base = (uint8_t*)p;
+    d->touched.assign(page_num, 0);
+
+    std::string suffix = "." + std::to_string(drams.size());
+    const char *load_prefix = getenv("SIM_DRAM_LOAD");
+    if(load_prefix) {
+        load(*d, (load_prefix + suffix).c_str());
+    }
+    const char *save_prefix = getenv("SIM_DRAM_SAVE");
+    if(save_prefix) {
+        d->save_path = save_prefix + suffix;
+        d->save_tmp_path = d->save_path + ".tmp";
+        if(drams.empty()) {
+            atexit(saveAll);
+            signal(SIGINT, saveOnSignal);
+            signal(SIGTERM, saveOnSignal);
+            signal(SIGHUP, saveOnSignal);
+        }
+    }
+    drams.push_back(d);
+    return drams.size() - 1;
+}
+
+unsigned long long simDramRead(unsigned int h, unsigned long long addr) {
+    uint64_t data;
+    memcpy(&data, drams[h]->base + addr, sizeof(data));
+    return data;
+}
+
+void simDramWrite(unsigned int h, unsigned long long addr,
+                  unsigned long long data, unsigned char be) {
+    SimDram &d = *drams[h];
+    d.touched[addr / page_bytes] = 1;
+    uint8_t *p = d.base + addr;
+    for(int i = 0; i < 8; i++) {
+        if((be >> i) & 1) {
+            p[i] = uint8_t(data >> (i * 8));
+        }
+    }
+}
+
+}
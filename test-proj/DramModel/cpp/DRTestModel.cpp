@@ -0,0 +1,161 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "DRTestModel.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+enum TestState {
+    InitData, // initialize each addr
+    Test, // random reads/writes
+    Check, // read back each addr
+    WaitDone // wait all reads to resp
+};
+
+// reference data and issue time of a read
+struct RefData {
+    DramLine data;
+    uint64_t issue_time;
+};
+
+}
+
+DRTestModelResult runDRTestModel(const DRTestModelConfig &test, const DramModelConfig &dram) {
+    const std::vector<uint32_t> &addrs = *test.addrs;
+    const uint32_t addr_idx_mask = addrs.size() - 1;
+
+    DramModel model(dram);
+    RandDramUserData rand_data;
+    RandDramUserBE rand_be;
+    RandAddrIdx rand_idx;
+    RandRatio send_stall(test.log_stall_ratio);
+    RandRatio recv_stall(test.log_stall_ratio);
+    rand_data.seed(test.data_seed);
+    rand_be.seed(test.be_seed);
+    rand_idx.seed(test.idx_seed);
+    send_stall.setRatio(test.send_stall);
+    recv_stall.setRatio(test.recv_stall);
+
+    std::vector<DramLine> data_ram(addrs.size());
+    // refQ in DRTest.bsv
+    Ring<RefData> ref_q(1024);
+
+    DRTestModelResult res;
+    memset(&res, 0, sizeof(res));
+    res.rd_lat_min = UINT64_MAX;
+
+    TestState state = InitData;
+    uint32_t addr_idx = 0;
+    uint64_t send_cnt = 0;
+    // reads of check state are counted at start
+    uint64_t send_rd_cnt = addrs.size();
+    uint64_t recv_rd_cnt = 0;
+    uint64_t begin_time = model.cycle();
+
+    while(true) {
+        uint64_t clk = model.cycle();
+
+        // recv DRAM resp and check
+        bool recv_stalled = recv_stall.value();
+        recv_stall.next();
+        if(!recv_stalled && model.hasResp()) {
+            DramLine d = model.resp();
+            const RefData &ref = ref_q.front();
+            if(d != ref.data) {
+                if(res.err_num == 0) {
+                    fprintf(stderr, "ERROR: model read %llu data mismatch\n",
+                            (long long unsigned)recv_rd_cnt);
+                }
+                res.err_num++;
+            }
+            uint64_t lat = clk - ref.issue_time;
+            res.rd_lat_sum += lat;
+            res.rd_lat_min = lat < res.rd_lat_min ? lat : res.rd_lat_min;
+            res.rd_lat_max = lat > res.rd_lat_max ? lat : res.rd_lat_max;
+            ref_q.pop();
+            recv_rd_cnt++;
+        }
+
+        // select addr idx and req
+        bool send_stalled = send_stall.value();
+        send_stall.next();
+        if(state == WaitDone) {
+            if(recv_rd_cnt == send_rd_cnt) {
+                break;
+            }
+        }
+        else if(model.canReq() && !ref_q.full() && !(state == Test && send_stalled)) {
+            uint32_t idx = addr_idx;
+            uint64_t be = 0;
+            if(state == InitData) {
+                be = ~uint64_t(0);
+                if(addr_idx == addr_idx_mask) {
+                    addr_idx = 0;
+                    state = Test;
+                }
+                else {
+                    addr_idx++;
+                }
+            }
+            else if(state == Test) {
+                idx = rand_idx.get() & addr_idx_mask;
+                be = rand_be.get();
+                send_cnt++;
+                if(be == 0) {
+                    send_rd_cnt++;
+                }
+                if(send_cnt == test.test_num) {
+                    state = Check;
+                }
+            }
+            else {
+                if(addr_idx == addr_idx_mask) {
+                    addr_idx = 0;
+                    state = WaitDone;
+                }
+                else {
+                    addr_idx++;
+                }
+            }
+            // random data for every req
+            DramLine data = rand_data.get();
+            data_ram[idx].merge(data, be);
+            if(be == 0) {
+                RefData &ref = ref_q.push();
+                ref.data = data_ram[idx];
+                ref.issue_time = clk;
+            }
+            model.req(addrs[idx], be, data);
+        }
+
+        model.tick();
+    }
+
+    res.pass = res.err_num == 0;
+    res.elap_time = model.cycle() - begin_time;
+    res.rd_num = recv_rd_cnt;
+    res.dram = model.stats();
+    return res;
+}
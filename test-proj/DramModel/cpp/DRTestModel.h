@@ -0,0 +1,56 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "DramModel.h"
+
+// C++ port of mkDRTest (DramRandTest/bsv/DRTest.bsv) driving DramModel:
+// initialize all test addrs, send test_num random reads/writes (same LFSRs
+// as HW), then read back all addrs. All read resps are checked.
+struct DRTestModelConfig {
+    const std::vector<uint32_t> *addrs; // test addrs, size is power of 2
+    uint64_t test_num;
+    int log_stall_ratio; // LOG_STALL_RATIO
+    uint32_t send_stall;
+    uint32_t recv_stall;
+    uint32_t data_seed;
+    uint32_t be_seed;
+    uint32_t idx_seed;
+};
+
+// same as DoneResp in DRTest.bsv, plus controller counters
+struct DRTestModelResult {
+    bool pass;
+    uint64_t err_num;
+    uint64_t elap_time;
+    uint64_t rd_lat_sum;
+    uint64_t rd_num;
+    uint64_t rd_lat_min;
+    uint64_t rd_lat_max;
+    DramModelStats dram;
+};
+
+DRTestModelResult runDRTestModel(const DRTestModelConfig &test, const DramModelConfig &dram);
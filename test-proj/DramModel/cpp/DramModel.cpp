@@ -0,0 +1,197 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "DramModel.h"
+#include <string.h>
+
+DramModel::DramModel(const DramModelConfig &c) :
+    cfg(c),
+    clk(0),
+    reqQ(2),
+    respQ(2),
+    pendReadQ(c.max_read_num),
+    dramReadQ(c.max_read_num),
+    rdAddrQ(c.max_read_num),
+    rdAddrCnt(c.max_read_num),
+    wrBuff(c.max_write_num > 0 ? c.max_write_num : 1),
+    wrHead(0),
+    wrNum(0),
+    wrLines(c.max_write_num > 0 ? c.max_write_num : 1),
+    dramWriteQ(c.max_write_num > 0 ? c.max_write_num : 1),
+    memIdx(1024)
+{
+    memset(&st, 0, sizeof(st));
+}
+
+void DramModel::req(uint64_t addr, uint64_t be, const DramLine &data) {
+    Req &r = reqQ.push();
+    r.addr = addr;
+    r.be = be;
+    r.data = data;
+}
+
+DramLine DramModel::resp() {
+    DramLine d = respQ.front();
+    respQ.pop();
+    return d;
+}
+
+void DramModel::readMem(uint64_t addr, DramLine &d) {
+    uint32_t *idx = memIdx.find(addr);
+    if(idx) {
+        d = mem[*idx - 1];
+    }
+    else {
+        memset(&d, 0, sizeof(d));
+    }
+}
+
+void DramModel::writeMem(uint64_t addr, uint64_t be, const DramLine &d) {
+    uint32_t &idx = memIdx.insert(addr);
+    if(idx == 0) {
+        // new line (idx is 1-based so that 0 is a new entry)
+        mem.push_back(DramLine());
+        memset(&mem.back(), 0, sizeof(DramLine));
+        idx = mem.size();
+    }
+    mem[idx - 1].merge(d, be);
+}
+
+// doReadReq in mkAWSDramController
+bool DramModel::doReadReq(const Req &r) {
+    WrLine *l = cfg.max_write_num > 0 ? wrLines.find(r.addr) : 0;
+    if(l && wrBuff[l->youngest].be != ~uint64_t(0)) {
+        st.forward_stall++;
+        return false;
+    }
+    if(pendReadQ.full()) {
+        st.rd_limit_stall++;
+        return false;
+    }
+    PendRead &p = pendReadQ.push();
+    if(l) {
+        p.forward = true;
+        p.data = wrBuff[l->youngest].data;
+        st.forward_num++;
+    }
+    else {
+        p.forward = false;
+        DramRead &d = dramReadQ.push();
+        d.ready = clk + cfg.rd_latency;
+        readMem(r.addr, d.data);
+        rdAddrQ.push() = r.addr;
+        rdAddrCnt.insert(r.addr)++;
+    }
+    st.read_num++;
+    return true;
+}
+
+// doWriteReq in mkAWSDramController
+bool DramModel::doWriteReq(const Req &r) {
+    if(cfg.max_write_num == 0) {
+        writeMem(r.addr, r.be, r.data);
+        st.write_num++;
+        return true;
+    }
+    if(rdAddrCnt.find(r.addr)) {
+        st.war_stall++;
+        return false;
+    }
+    if(wrNum >= size_t(cfg.max_write_num)) {
+        st.wr_limit_stall++;
+        return false;
+    }
+    size_t slot = (wrHead + wrNum) % cfg.max_write_num;
+    WrEntry &e = wrBuff[slot];
+    e.addr = r.addr;
+    WrLine &l = wrLines.insert(r.addr);
+    if(l.cnt > 0) {
+        // combine with youngest write to the same line
+        const WrEntry &y = wrBuff[l.youngest];
+        e.data = y.data;
+        e.be = y.be | r.be;
+        e.data.merge(r.data, r.be);
+    }
+    else {
+        e.data = r.data;
+        e.be = r.be;
+    }
+    l.youngest = slot;
+    l.cnt++;
+    wrNum++;
+    writeMem(r.addr, r.be, r.data);
+    dramWriteQ.push() = clk + cfg.wr_latency;
+    st.write_num++;
+    return true;
+}
+
+void DramModel::tick() {
+    // perf counters sampled at the beginning of cycle
+    size_t rd_num = pendReadQ.size();
+    if(!reqQ.empty() || rd_num != 0 || wrNum != 0) {
+        st.busy_cycles++;
+    }
+    st.rd_occupancy += rd_num;
+
+    // read resp in order, either forwarded or from DRAM
+    if(!pendReadQ.empty() && !respQ.full()) {
+        PendRead &p = pendReadQ.front();
+        if(p.forward) {
+            respQ.push() = p.data;
+            pendReadQ.pop();
+        }
+        else if(!dramReadQ.empty() && dramReadQ.front().ready <= clk) {
+            respQ.push() = dramReadQ.front().data;
+            dramReadQ.pop();
+            pendReadQ.pop();
+            uint64_t addr = rdAddrQ.front();
+            rdAddrQ.pop();
+            uint32_t *cnt = rdAddrCnt.find(addr);
+            if(--*cnt == 0) {
+                rdAddrCnt.erase(addr);
+            }
+        }
+    }
+
+    // write resp: deq oldest write from write buffer
+    if(!dramWriteQ.empty() && dramWriteQ.front() <= clk) {
+        dramWriteQ.pop();
+        uint64_t addr = wrBuff[wrHead].addr;
+        WrLine *l = wrLines.find(addr);
+        if(--l->cnt == 0) {
+            wrLines.erase(addr);
+        }
+        wrHead = (wrHead + 1) % cfg.max_write_num;
+        wrNum--;
+    }
+
+    // new req
+    if(!reqQ.empty()) {
+        const Req &r = reqQ.front();
+        if(r.be == 0 ? doReadReq(r) : doWriteReq(r)) {
+            reqQ.pop();
+        }
+    }
+
+    clk++;
+}
@@ -0,0 +1,271 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "Random.h"
+
+// Cycle-level C++ model of the DramUser controllers (lib/AWSDramController.bsv
+// without bursts, and DDR3 when maxWriteNum is 0), for exploring buffer sizes
+// much faster than Bluesim.
+//
+// Like mkAWSDramController, a read searches the write buffer (mkWriteBuffer)
+// and is forwarded if the youngest write to the line covers all bytes, stalls
+// if it is partial, or goes to DRAM and enters the read addr buffer
+// (mkAddrBuffer). A write stalls while a read of the same line is in DRAM,
+// then enters the write buffer (combined with older writes to the line) until
+// DRAM acks it. pendReadQ holds at most maxReadNum reads (forwarded or not).
+// DRAM is fully pipelined with fixed read/write latency and keeps each kind
+// of req in order, like AXI with a single ID.
+//
+// Each FIFO between rules is a queue read in the next cycle, so timing is
+// close to (but not exactly the same as) the BSV schedule.
+
+struct DramModelConfig {
+    int max_read_num;
+    int max_write_num; // 0: no write buffer (DDR3)
+    int rd_latency; // cycles from req to resp of DRAM
+    int wr_latency;
+};
+
+// counters of DramPerfType (AWS controller), plus write buffer full stalls
+struct DramModelStats {
+    uint64_t busy_cycles;
+    uint64_t read_num;
+    uint64_t write_num;
+    uint64_t forward_num;
+    uint64_t forward_stall;
+    uint64_t war_stall;
+    uint64_t rd_limit_stall;
+    uint64_t wr_limit_stall;
+    uint64_t rd_occupancy;
+};
+
+// fixed capacity queue
+template<typename T>
+class Ring {
+public:
+    Ring(size_t cap) : buf(roundUp(cap)), mask(buf.size() - 1), limit(cap), head(0), tail(0) {}
+
+    size_t size() const { return tail - head; }
+    bool empty() const { return head == tail; }
+    bool full() const { return size() >= limit; }
+    T &front() { return buf[head & mask]; }
+    T &back() { return buf[(tail - 1) & mask]; }
+    T &push() { return buf[tail++ & mask]; } // returns new entry
+    void pop() { head++; }
+
+private:
+    std::vector<T> buf;
+    size_t mask;
+    size_t limit;
+    size_t head;
+    size_t tail;
+
+    static size_t roundUp(size_t n) {
+        size_t s = 1;
+        while(s < n) {
+            s <<= 1;
+        }
+        return s;
+    }
+};
+
+// open addressing hash table of line addrs, used for buffer search instead of
+// the associative search in BSV
+template<typename V>
+class AddrTable {
+public:
+    AddrTable(size_t max_num);
+
+    V *find(uint64_t addr);
+    V &insert(uint64_t addr); // existing or new (value-initialized) entry
+    void erase(uint64_t addr); // addr must exist
+    size_t size() const { return num; }
+
+private:
+    struct Slot {
+        bool valid;
+        uint64_t addr;
+        V val;
+    };
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t num;
+    int shift;
+
+    size_t home(uint64_t addr) const {
+        return size_t((addr * 0x9E3779B97F4A7C15ull) >> shift) & mask;
+    }
+    void grow();
+};
+
+template<typename V>
+AddrTable<V>::AddrTable(size_t max_num) : num(0) {
+    size_t n = 16;
+    shift = 60;
+    while(n < 2 * max_num) {
+        n <<= 1;
+        shift--;
+    }
+    slots.resize(n);
+    mask = n - 1;
+}
+
+template<typename V>
+V *AddrTable<V>::find(uint64_t addr) {
+    for(size_t i = home(addr); slots[i].valid; i = (i + 1) & mask) {
+        if(slots[i].addr == addr) {
+            return &slots[i].val;
+        }
+    }
+    return 0;
+}
+
+template<typename V>
+V &AddrTable<V>::insert(uint64_t addr) {
+    if(2 * (num + 1) > slots.size()) {
+        grow();
+    }
+    size_t i = home(addr);
+    for(; slots[i].valid; i = (i + 1) & mask) {
+        if(slots[i].addr == addr) {
+            return slots[i].val;
+        }
+    }
+    slots[i].valid = true;
+    slots[i].addr = addr;
+    slots[i].val = V();
+    num++;
+    return slots[i].val;
+}
+
+template<typename V>
+void AddrTable<V>::erase(uint64_t addr) {
+    size_t i = home(addr);
+    while(slots[i].addr != addr || !slots[i].valid) {
+        i = (i + 1) & mask;
+    }
+    // backward shift deletion: move later entries of the probe chain into the
+    // hole if their home is not between the hole and them
+    size_t j = i;
+    while(true) {
+        j = (j + 1) & mask;
+        if(!slots[j].valid) {
+            break;
+        }
+        size_t h = home(slots[j].addr);
+        if(((j - h) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].valid = false;
+    num--;
+}
+
+template<typename V>
+void AddrTable<V>::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.size() * 2);
+    mask = slots.size() - 1;
+    shift--;
+    num = 0;
+    for(size_t i = 0; i < old.size(); i++) {
+        if(old[i].valid) {
+            insert(old[i].addr) = old[i].val;
+        }
+    }
+}
+
+class DramModel {
+public:
+    DramModel(const DramModelConfig &c);
+
+    // DramUser methods
+    bool canReq() const { return !reqQ.full(); }
+    void req(uint64_t addr, uint64_t be, const DramLine &data);
+    bool hasResp() const { return !respQ.empty(); }
+    DramLine resp(); // deq read resp
+
+    // advance one cycle
+    void tick();
+
+    uint64_t cycle() const { return clk; }
+    const DramModelStats &stats() const { return st; }
+
+private:
+    struct Req {
+        uint64_t addr;
+        uint64_t be;
+        DramLine data;
+    };
+    struct PendRead {
+        bool forward;
+        DramLine data; // forwarded data
+    };
+    struct DramRead {
+        uint64_t ready; // cycle of resp
+        DramLine data;
+    };
+    struct WrEntry {
+        uint64_t addr;
+        uint64_t be; // merged byte enables
+        DramLine data; // merged data
+    };
+    struct WrLine {
+        size_t youngest; // idx of youngest entry in wrBuff
+        uint32_t cnt; // number of entries
+    };
+
+    DramModelConfig cfg;
+    uint64_t clk;
+    DramModelStats st;
+
+    Ring<Req> reqQ;
+    Ring<DramLine> respQ;
+    Ring<PendRead> pendReadQ;
+    // reads in DRAM, and their addrs (read addr buffer)
+    Ring<DramRead> dramReadQ;
+    Ring<uint64_t> rdAddrQ;
+    AddrTable<uint32_t> rdAddrCnt;
+    // write buffer entries (in order) and resp time of each write in DRAM
+    std::vector<WrEntry> wrBuff;
+    size_t wrHead;
+    size_t wrNum;
+    AddrTable<WrLine> wrLines;
+    Ring<uint64_t> dramWriteQ;
+
+    // DRAM content: addr -> line idx
+    AddrTable<uint32_t> memIdx;
+    std::vector<DramLine> mem;
+
+    void readMem(uint64_t addr, DramLine &d);
+    void writeMem(uint64_t addr, uint64_t be, const DramLine &d);
+    bool doReadReq(const Req &r);
+    bool doWriteReq(const Req &r);
+};
@@ -0,0 +1,135 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+
+// Bit-exact C++ ports of the randomizers in DramRandTest/bsv/Random.bsv, so a
+// model run with the same seeds produces the same traffic as mkDRTest.
+
+// mkLFSR_32 in Bluespec LFSR library (Galois LFSR, reset value 1). value() is
+// the value returned by the BSV method in the same cycle as next().
+class Lfsr32 {
+public:
+    Lfsr32() : r(1) {}
+    void seed(uint32_t s) { r = s; }
+    uint32_t value() const { return r; }
+    void next() { r = (r & 1) ? (r >> 1) ^ feed : r >> 1; }
+    // value, then next (ActionValue method in Random.bsv)
+    uint32_t get() {
+        uint32_t v = r;
+        next();
+        return v;
+    }
+
+private:
+    static const uint32_t feed = 0x80000057;
+    uint32_t r;
+};
+
+// 512-bit DRAM line, byte i is bits 8i+7 ~ 8i
+struct DramLine {
+    uint64_t w[8];
+
+    bool operator==(const DramLine &x) const {
+        for(int i = 0; i < 8; i++) {
+            if(w[i] != x.w[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool operator!=(const DramLine &x) const { return !(*this == x); }
+
+    // set bytes enabled in be to the bytes of d
+    void merge(const DramLine &d, uint64_t be) {
+        for(int i = 0; i < 8; i++) {
+            uint64_t m = byteMask(be >> (8 * i) & 0xFF);
+            w[i] = (w[i] & ~m) | (d.w[i] & m);
+        }
+    }
+
+    // expand 8 byte enables to 64-bit mask
+    static uint64_t byteMask(uint64_t b) {
+        b = (b | b << 28) & 0x0000000F0000000Full;
+        b = (b | b << 14) & 0x0003000300030003ull;
+        b = (b | b << 7) & 0x0101010101010101ull;
+        return b * 0xFF;
+    }
+};
+
+// mkRandDramUserData: 32-bit LFSR value replicated
+class RandDramUserData {
+public:
+    void seed(uint32_t s) { lfsr.seed(s); }
+    DramLine get() {
+        uint64_t r = lfsr.get();
+        DramLine l;
+        for(int i = 0; i < 8; i++) {
+            l.w[i] = r << 32 | r;
+        }
+        return l;
+    }
+
+private:
+    Lfsr32 lfsr;
+};
+
+// mkRandDramUserBE: read if bit 15 is 0, otherwise LFSR value replicated
+class RandDramUserBE {
+public:
+    void seed(uint32_t s) { lfsr.seed(s); }
+    uint64_t get() {
+        uint64_t r = lfsr.get();
+        return (r >> 15 & 1) == 0 ? 0 : r << 32 | r;
+    }
+
+private:
+    Lfsr32 lfsr;
+};
+
+// mkRandAddrIdx: LSBs of LFSR value (caller masks them)
+class RandAddrIdx {
+public:
+    void seed(uint32_t s) { lfsr.seed(s); }
+    uint32_t get() { return lfsr.get(); }
+
+private:
+    Lfsr32 lfsr;
+};
+
+// mkRandRatio#(n): LFSR advances every cycle, value is 1 if the n MSBs are
+// less than ratio
+class RandRatio {
+public:
+    RandRatio(int n) : bits(n), threshold(0) {}
+    void setRatio(uint32_t x) { threshold = x; }
+    bool value() const { return (lfsr.value() >> (32 - bits)) < threshold; }
+    void next() { lfsr.next(); }
+
+private:
+    Lfsr32 lfsr;
+    int bits;
+    uint32_t threshold;
+};
@@ -0,0 +1,244 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "DramModel.h"
+#include "DRTestModel.h"
+#include "AddrGen.h"
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+void usage(char *prog) {
+    fprintf(stderr, "Usage: %s [OPTIONS] LOG_ADDR_NUM TEST_NUM SEND_STALL RECV_STALL\n", prog);
+    fprintf(stderr, "Run DramRandTest traffic on a C++ model of the DRAM controller, "
+            "for each combination of:\n"
+            "  -r LIST    max reads in flight, comma separated (default 16)\n"
+            "  -w LIST    max writes in flight, 0 for no write buffer like DDR3 "
+            "(default 16)\n"
+            "  -l LIST    DRAM read/write latency in cycles (default 10)\n"
+            "Other options:\n"
+            "  -p PATTERN pattern of test addrs (unique, bank, conflict, stripe), "
+            "see DramRandTest\n"
+            "  -s SEEDS   DATA,BE,IDX,ADDR seeds in hex (default random), the same "
+            "seeds as DramRandTest replay the same reqs\n"
+            "  -j N       number of threads (default number of cores)\n"
+            "SEND_STALL and RECV_STALL are out of 2^LOG_STALL_RATIO (%d)\n",
+            LOG_STALL_RATIO);
+}
+
+bool parseList(const char *s, int min, std::vector<int> &v) {
+    v.clear();
+    std::string str(s);
+    size_t pos = 0;
+    while(pos <= str.size()) {
+        size_t end = str.find(',', pos);
+        if(end == std::string::npos) {
+            end = str.size();
+        }
+        int x = atoi(str.substr(pos, end - pos).c_str());
+        if(x < min) {
+            fprintf(stderr, "ERROR: %d in %s must >= %d\n", x, s, min);
+            return false;
+        }
+        v.push_back(x);
+        pos = end + 1;
+    }
+    return true;
+}
+
+unsigned int getSeed() {
+    while(1) {
+        int r = rand();
+        if(r != 0) {
+            return r;
+        }
+    }
+}
+
+struct SweepPoint {
+    DramModelConfig dram;
+    DRTestModelResult res;
+    double host_time; // seconds
+};
+
+int main(int argc, char *argv[]) {
+    std::vector<int> rd_nums(1, 16);
+    std::vector<int> wr_nums(1, 16);
+    std::vector<int> lats(1, 10);
+    AddrPattern addr_pattern = UniqueLines;
+    int thread_num = std::thread::hardware_concurrency();
+
+    srand(time(0));
+    unsigned int data_seed = getSeed();
+    unsigned int be_seed = getSeed();
+    unsigned int idx_seed = getSeed();
+    unsigned int addr_seed = getSeed();
+
+    int opt;
+    while((opt = getopt(argc, argv, "r:w:l:p:s:j:h")) != -1) {
+        bool ok = true;
+        switch(opt) {
+            case 'r': ok = parseList(optarg, 1, rd_nums); break;
+            case 'w': ok = parseList(optarg, 0, wr_nums); break;
+            case 'l': ok = parseList(optarg, 1, lats); break;
+            case 'p': ok = parseAddrPattern(optarg, addr_pattern); break;
+            case 's':
+                ok = sscanf(optarg, "%x,%x,%x,%x",
+                            &data_seed, &be_seed, &idx_seed, &addr_seed) == 4;
+                break;
+            case 'j': thread_num = atoi(optarg); ok = thread_num > 0; break;
+            default: ok = false;
+        }
+        if(!ok) {
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if(argc - optind != 4) {
+        usage(argv[0]);
+        return 0;
+    }
+    int log_addr_num = atoi(argv[optind]);
+    if(log_addr_num < 0 || log_addr_num > 31) {
+        fprintf(stderr, "LOG_ADDR_NUM must be in [0, 31]\n");
+        return 0;
+    }
+    uint64_t addr_num = uint64_t(1) << log_addr_num;
+    long long unsigned test_num = std::stoull(argv[optind + 1]);
+    if(test_num == 0) {
+        fprintf(stderr, "test num must > 0\n");
+        return 0;
+    }
+    const int max_stall = (1 << LOG_STALL_RATIO) - 1;
+    int send_stall = atoi(argv[optind + 2]);
+    int recv_stall = atoi(argv[optind + 3]);
+    if(send_stall < 0 || send_stall > max_stall || recv_stall < 0 || recv_stall > max_stall) {
+        fprintf(stderr, "stalls must be in [0, %d]\n", max_stall);
+        return 0;
+    }
+
+    const DramGeometry &geo = getDramGeometry();
+    std::vector<uint32_t> addrs;
+    if(!genAddrs(geo, addr_pattern, addr_num, addr_seed, addrs)) {
+        fprintf(stderr, "ERROR: %s cannot hold %llu addrs\n", geo.name,
+                (long long unsigned)addr_num);
+        return 0;
+    }
+    fprintf(stderr, "INFO: %llu %s addrs in %s, test num %llu, send stall %d/%d, "
+            "recv stall %d/%d\n", (long long unsigned)addr_num,
+            getAddrPatternName(addr_pattern), geo.name, test_num,
+            send_stall, max_stall + 1, recv_stall, max_stall + 1);
+    fprintf(stderr, "INFO: seeds (-s) %x,%x,%x,%x\n", data_seed, be_seed, idx_seed, addr_seed);
+
+    DRTestModelConfig test;
+    test.addrs = &addrs;
+    test.test_num = test_num;
+    test.log_stall_ratio = LOG_STALL_RATIO;
+    test.send_stall = send_stall;
+    test.recv_stall = recv_stall;
+    test.data_seed = data_seed;
+    test.be_seed = be_seed;
+    test.idx_seed = idx_seed;
+
+    std::vector<SweepPoint> points;
+    for(size_t i = 0; i < rd_nums.size(); i++) {
+        for(size_t j = 0; j < wr_nums.size(); j++) {
+            for(size_t k = 0; k < lats.size(); k++) {
+                SweepPoint p;
+                p.dram.max_read_num = rd_nums[i];
+                p.dram.max_write_num = wr_nums[j];
+                p.dram.rd_latency = lats[k];
+                p.dram.wr_latency = lats[k];
+                points.push_back(p);
+            }
+        }
+    }
+
+    // each thread takes the next point
+    std::atomic<size_t> next_point(0);
+    auto worker = [&]() {
+        while(true) {
+            size_t i = next_point++;
+            if(i >= points.size()) {
+                break;
+            }
+            auto begin = std::chrono::steady_clock::now();
+            points[i].res = runDRTestModel(test, points[i].dram);
+            std::chrono::duration<double> t = std::chrono::steady_clock::now() - begin;
+            points[i].host_time = t.count();
+        }
+    };
+    if(size_t(thread_num) > points.size()) {
+        thread_num = points.size();
+    }
+    std::vector<std::thread> threads;
+    for(int i = 0; i < thread_num; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    for(size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    // report in sweep order
+    Bench bench("DramModel");
+    bench.beginRun(0);
+    uint64_t total_num = test_num + 2 * addr_num;
+    bool pass = true;
+    fprintf(stderr, "%6s %6s %4s | %5s %10s %9s %6s %6s | %9s %9s %9s %9s %9s | %8s\n",
+            "maxRd", "maxWr", "lat", "pass", "cycles", "data/cyc", "rdLat", "rdMax",
+            "forward", "fwdStall", "warStall", "rdLimit", "wrLimit", "Mreq/s");
+    for(size_t i = 0; i < points.size(); i++) {
+        const SweepPoint &p = points[i];
+        const DRTestModelResult &r = p.res;
+        double tp = double(total_num) / double(r.elap_time);
+        double lat = r.rd_num > 0 ? double(r.rd_lat_sum) / double(r.rd_num) : 0;
+        double speed = double(total_num) / p.host_time / 1e6;
+        fprintf(stderr, "%6d %6d %4d | %5s %10llu %9.4f %6.1f %6llu | %9llu %9llu %9llu %9llu %9llu | %8.2f\n",
+                p.dram.max_read_num, p.dram.max_write_num, p.dram.rd_latency,
+                r.pass ? "PASS" : "FAIL", (long long unsigned)r.elap_time, tp, lat,
+                (long long unsigned)r.rd_lat_max,
+                (long long unsigned)r.dram.forward_num,
+                (long long unsigned)r.dram.forward_stall,
+                (long long unsigned)r.dram.war_stall,
+                (long long unsigned)r.dram.rd_limit_stall,
+                (long long unsigned)r.dram.wr_limit_stall,
+                speed);
+        pass = pass && r.pass;
+        std::string name = "r" + std::to_string(p.dram.max_read_num) +
+                           "_w" + std::to_string(p.dram.max_write_num) +
+                           "_l" + std::to_string(p.dram.rd_latency) + "_";
+        bench.record(name + "throughput", tp, "data/cycle", true);
+        bench.record(name + "rd_lat", lat, "cycles", false);
+        bench.record(name + "model_speed", speed, "Mreq/s", true);
+    }
+    int ret = bench.finish();
+    return pass ? ret : -1;
+}
@@ -0,0 +1,169 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "AddrGen.h"
+#include <string.h>
+#include <random>
+#include <algorithm>
+
+// VC707 1GB DDR3: 8 banks, 16K rows, 8KB row (128 lines)
+static const DramGeometry vc707_ddr3 = {"VC707 DDR3", 7, 0, 3, 14};
+
+// AWS F1 DDR4 (one 16GB channel): 4 bank groups x 4 banks, 8KB row; only
+// 1GB in simulation without SIM_DRAM_SPARSE
+#if defined(BSIM) && !defined(SIM_DRAM_SPARSE)
+static const DramGeometry awsf1_ddr4 = {"AWSF1 DDR4 (sim)", 7, 0, 4, 13};
+#else
+static const DramGeometry awsf1_ddr4 = {"AWSF1 DDR4", 7, 0, 4, 17};
+#endif
+
+const DramGeometry &getDramGeometry() {
+#ifdef TEST_VC707
+    return vc707_ddr3;
+#else
+    return awsf1_ddr4;
+#endif
+}
+
+static const char *addr_pattern_name[AddrPatternNum] = {
+    "unique", "bank", "conflict", "stripe"
+};
+
+const char *getAddrPatternName(AddrPattern p) {
+    return addr_pattern_name[p];
+}
+
+bool parseAddrPattern(const char *s, AddrPattern &p) {
+    for(int i = 0; i < AddrPatternNum; i++) {
+        if(strcmp(s, addr_pattern_name[i]) == 0) {
+            p = AddrPattern(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// random distinct lines: rejection sampling with a bitmap when the set is
+// sparse, otherwise selection sampling over the whole space
+static void genUniqueLines(uint64_t space, uint64_t addr_num,
+                           std::mt19937_64 &gen, std::vector<uint32_t> &addrs) {
+    if(addr_num * 2 <= space) {
+        std::vector<uint64_t> used((space + 63) / 64, 0);
+        while(addrs.size() < addr_num) {
+            uint64_t a = gen() & (space - 1);
+            uint64_t &w = used[a / 64];
+            uint64_t bit = 1ULL << (a % 64);
+            if(!(w & bit)) {
+                w |= bit;
+                addrs.push_back(uint32_t(a));
+            }
+        }
+    }
+    else {
+        uint64_t need = addr_num;
+        for(uint64_t a = 0; a < space && need > 0; a++) {
+            if(gen() % (space - a) < need) {
+                addrs.push_back(uint32_t(a));
+                need--;
+            }
+        }
+        std::shuffle(addrs.begin(), addrs.end(), gen);
+    }
+}
+
+bool genAddrs(const DramGeometry &geo, AddrPattern p, uint64_t addr_num,
+              uint64_t seed, std::vector<uint32_t> &addrs) {
+    const uint64_t space = 1ULL << geo.addrBits();
+    if(addr_num > space) {
+        return false;
+    }
+    addrs.clear();
+    addrs.reserve(addr_num);
+    std::mt19937_64 gen(seed);
+
+    if(p == UniqueLines) {
+        genUniqueLines(space, addr_num, gen, addrs);
+        return true;
+    }
+
+    const uint64_t cols = 1ULL << geo.col_bits;
+    const uint64_t chans = 1ULL << geo.chan_bits;
+    const uint64_t banks = 1ULL << geo.bank_bits;
+    const uint64_t rows = 1ULL << geo.row_bits;
+    // units accessed in parallel: channels first, then banks
+    const uint64_t units = chans * banks;
+
+    // rows/cols/units are visited in a random order: an odd stride is a
+    // permutation of a power-of-2 range
+    const uint64_t row_off = gen();
+    const uint64_t row_stride = gen() | 1;
+    const uint64_t col_off = gen();
+    const uint64_t unit_off = gen();
+    const uint64_t line_off = gen();
+
+    for(uint64_t i = 0; i < addr_num; i++) {
+        uint64_t unit = 0;
+        uint64_t row = 0;
+        uint64_t col = 0;
+        if(p == SameRowDiffBank) {
+            // same row & col in all units, then next col, then next row
+            unit = i % units;
+            col = (col_off + i / units) % cols;
+            row = (row_off + (i / units / cols) * row_stride) % rows;
+        }
+        else if(p == RowConflict) {
+            // different row in the same unit, then next col, then next unit
+            row = (row_off + (i % rows) * row_stride) % rows;
+            col = (col_off + i / rows) % cols;
+            unit = (unit_off + i / rows / cols) % units;
+        }
+        else {
+            // sequential lines in each channel, interleaved across channels
+            uint64_t line = (line_off + i / chans) % (space / chans);
+            unit = (line / cols % banks) * chans + i % chans;
+            col = line % cols;
+            row = line / cols / banks;
+        }
+        addrs.push_back(uint32_t(geo.compose(row, unit / chans, unit % chans, col)));
+    }
+    return true;
+}
+
+void writeAddrs(FILE *fp, const DramGeometry &geo, const std::vector<uint32_t> &addrs) {
+    static const char hex[] = "0123456789abcdef";
+    const int digits = (geo.addrBits() + 3) / 4;
+    const size_t buf_size = 1 << 20;
+    std::vector<char> buf(buf_size);
+    size_t pos = 0;
+    for(size_t i = 0; i < addrs.size(); i++) {
+        if(pos + digits + 1 > buf_size) {
+            fwrite(&buf[0], 1, pos, fp);
+            pos = 0;
+        }
+        for(int d = digits - 1; d >= 0; d--) {
+            buf[pos++] = hex[(addrs[i] >> (4 * d)) & 0xF];
+        }
+        buf[pos++] = '\n';
+    }
+    fwrite(&buf[0], 1, pos, fp);
+}
@@ -0,0 +1,67 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// DRAM geometry in terms of user addr (64B line), from LSB to MSB:
+// column (line within a row), channel, bank, row
+struct DramGeometry {
+    const char *name;
+    int col_bits;
+    int chan_bits;
+    int bank_bits;
+    int row_bits;
+
+    int addrBits() const {
+        return col_bits + chan_bits + bank_bits + row_bits;
+    }
+    uint64_t compose(uint64_t row, uint64_t bank, uint64_t chan, uint64_t col) const {
+        return (((row << bank_bits | bank) << chan_bits | chan) << col_bits) | col;
+    }
+};
+
+// geometry of the DRAM under test (selected by TEST_VC707 or TEST_AWSF1)
+const DramGeometry &getDramGeometry();
+
+enum AddrPattern {
+    UniqueLines, // random distinct lines
+    SameRowDiffBank, // same row in all banks, then move to another row
+    RowConflict, // different rows in the same bank
+    ChannelStriped, // sequential lines striped across channels
+    AddrPatternNum
+};
+
+const char *getAddrPatternName(AddrPattern p);
+bool parseAddrPattern(const char *s, AddrPattern &p);
+
+// generate addr_num distinct addrs of pattern p in O(addr_num) time, return
+// false if the DRAM is too small
+bool genAddrs(const DramGeometry &geo, AddrPattern p, uint64_t addr_num,
+              uint64_t seed, std::vector<uint32_t> &addrs);
+
+// write addrs in hex, one per line
+void writeAddrs(FILE *fp, const DramGeometry &geo, const std::vector<uint32_t> &addrs);
@@ -0,0 +1,199 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "TraceFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+TraceFile::TraceFile() :
+    fd(-1),
+    map(0),
+    map_size(0),
+    max_line(0),
+    record_num(0),
+    has_data(false),
+    record_bytes(sizeof(TraceFileRecord)),
+    producer_done(false),
+    consumed(0),
+    holding(false),
+    bad_record(0),
+    clamped_delays(0)
+{
+    chunk_ready[0] = chunk_ready[1] = false;
+}
+
+TraceFile::~TraceFile() {
+    if(producer.joinable()) {
+        // let producer finish: release buffers until it is done
+        while(!next().empty());
+        producer.join();
+    }
+    close();
+}
+
+void TraceFile::close() {
+    if(map) {
+        munmap(map, map_size);
+        map = 0;
+    }
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool TraceFile::open(const char *path, uint64_t max_line_num) {
+    fd = ::open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "ERROR: cannot open trace %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || uint64_t(st.st_size) < sizeof(TraceFileHeader)) {
+        fprintf(stderr, "ERROR: trace %s has no header\n", path);
+        close();
+        return false;
+    }
+    map_size = st.st_size;
+    map = (uint8_t*)mmap(0, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: cannot mmap trace %s\n", path);
+        map = 0;
+        close();
+        return false;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    const TraceFileHeader *h = (const TraceFileHeader*)map;
+    if(memcmp(h->magic, trace_file_magic, sizeof(trace_file_magic)) != 0 ||
+       h->version != trace_file_version) {
+        fprintf(stderr, "ERROR: %s is not a version %u trace\n", path, trace_file_version);
+        close();
+        return false;
+    }
+    has_data = (h->flags & TraceFileHasData) != 0;
+    record_bytes = sizeof(TraceFileRecord) + (has_data ? trace_line_bytes : 0);
+    record_num = h->record_num;
+    if((map_size - sizeof(TraceFileHeader)) / record_bytes < record_num) {
+        fprintf(stderr, "ERROR: trace %s is truncated, should have %llu records\n",
+                path, (long long unsigned)record_num);
+        close();
+        return false;
+    }
+    max_line = max_line_num;
+    bad_record = record_num;
+    return true;
+}
+
+// apply advice to the pages of records [begin, end), only pages completely in
+// the range are affected
+void TraceFile::advise(uint64_t begin, uint64_t end, int advice) {
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t b = sizeof(TraceFileHeader) + begin * record_bytes;
+    uint64_t e = sizeof(TraceFileHeader) + end * record_bytes;
+    b = (b + page - 1) / page * page;
+    e = e / page * page;
+    if(b < e) {
+        madvise(map + b, e - b, advice);
+    }
+}
+
+void TraceFile::start(size_t chunk_size) {
+    producer = std::thread(&TraceFile::produce, this, chunk_size);
+}
+
+void TraceFile::produce(size_t chunk_size) {
+    uint64_t begin = 0;
+    for(uint64_t k = 0; begin < record_num; k++) {
+        int buf = k & 1;
+        uint64_t end = record_num - begin < chunk_size ? record_num : begin + chunk_size;
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            cond.wait(lk, [this, buf] { return !chunk_ready[buf]; });
+        }
+        // records of the previous use of buf are not needed any more
+        if(k >= 2) {
+            advise(begin - 2 * chunk_size, begin - chunk_size, MADV_DONTNEED);
+        }
+        advise(begin, end, MADV_WILLNEED);
+
+        // decode (no lock, the consumer does not touch buf)
+        std::vector<TraceEntry> &c = chunk[buf];
+        c.clear();
+        uint64_t clamped = 0;
+        uint64_t bad = record_num;
+        for(uint64_t i = begin; i < end; i++) {
+            const uint8_t *p = map + sizeof(TraceFileHeader) + i * record_bytes;
+            const TraceFileRecord *r = (const TraceFileRecord*)p;
+            uint64_t line = r->addr / trace_line_bytes;
+            if(line >= max_line) {
+                bad = i;
+                break;
+            }
+            TraceEntry e;
+            e.line = line;
+            e.delay = r->delay > UINT16_MAX ? UINT16_MAX : r->delay;
+            e.be = r->be;
+            e.data = has_data ? (const uint64_t*)(p + sizeof(TraceFileRecord)) : 0;
+            clamped += r->delay > UINT16_MAX;
+            c.push_back(e);
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            clamped_delays += clamped;
+            chunk_ready[buf] = true;
+            bad_record = bad;
+            cond.notify_all();
+        }
+        if(bad != record_num) {
+            break;
+        }
+        begin = end;
+    }
+    std::lock_guard<std::mutex> lk(lock);
+    producer_done = true;
+    cond.notify_all();
+}
+
+const std::vector<TraceEntry> &TraceFile::next() {
+    std::unique_lock<std::mutex> lk(lock);
+    if(holding) {
+        // release the chunk of last call
+        chunk_ready[(consumed - 1) & 1] = false;
+        holding = false;
+        cond.notify_all();
+    }
+    int buf = consumed & 1;
+    cond.wait(lk, [this, buf] { return chunk_ready[buf] || producer_done; });
+    if(!chunk_ready[buf] || chunk[buf].empty()) {
+        return empty;
+    }
+    consumed++;
+    holding = true;
+    return chunk[buf];
+}
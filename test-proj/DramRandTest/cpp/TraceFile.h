@@ -0,0 +1,116 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Memory trace to replay in DramRandTest. File layout (little endian):
+//   TraceFileHeader
+//   TraceFileRecord x record_num, each followed by 64B write data if
+//   TraceFileHasData is set in flags (data of reads is ignored)
+// Addr is a byte addr, the req accesses the 64B line containing it.
+const char trace_file_magic[8] = {'D', 'R', 'T', 'R', 'A', 'C', 'E', '\0'};
+const uint32_t trace_file_version = 1;
+const uint32_t TraceFileHasData = 1;
+const size_t trace_line_bytes = 64;
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t record_num;
+    uint64_t reserved;
+};
+
+struct TraceFileRecord {
+    uint64_t addr;
+    uint64_t be; // byte enable, 0 for read
+    uint32_t delay; // cycles after previous req (used when paced)
+    uint32_t reserved;
+};
+
+// decoded req to send to HW
+struct TraceEntry {
+    uint32_t line; // line addr
+    uint16_t delay; // saturated
+    uint64_t be;
+    const uint64_t *data; // 8 x 64-bit write data in the file, or NULL
+};
+
+// The trace file is mmaped, so multi-GB traces are never copied into memory.
+// A producer thread decodes records into two alternating chunks: one chunk is
+// paged in and decoded while the other is being sent to HW. Pages behind the
+// chunk being sent are dropped from the page cache.
+class TraceFile {
+public:
+    TraceFile();
+    ~TraceFile();
+
+    // map file and check header, lines must be < max_line_num
+    bool open(const char *path, uint64_t max_line_num);
+
+    uint64_t size() const { return record_num; }
+    bool hasData() const { return has_data; }
+
+    // start producer thread, chunk_size records per chunk
+    void start(size_t chunk_size);
+    // next chunk, valid until next call, empty after all records (or a bad
+    // record, see failed)
+    const std::vector<TraceEntry> &next();
+    bool failed() const { return bad_record != record_num; }
+    // number of delays saturated to 16 bits
+    uint64_t clampedDelays() const { return clamped_delays; }
+
+private:
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint64_t max_line;
+    uint64_t record_num;
+    bool has_data;
+    size_t record_bytes;
+
+    // double buffer
+    std::thread producer;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<TraceEntry> chunk[2];
+    bool chunk_ready[2];
+    bool producer_done;
+    uint64_t consumed; // number of chunks taken by next()
+    bool holding; // caller holds chunk (consumed - 1) & 1
+    uint64_t bad_record; // idx of first bad record, record_num if none
+    uint64_t clamped_delays;
+
+    const std::vector<TraceEntry> empty;
+
+    void produce(size_t chunk_size);
+    void advise(uint64_t begin, uint64_t end, int advice);
+    void close();
+};
@@ -24,29 +24,196 @@
 #include "GeneratedTypes.h"
 #include "DRTestRequest.h"
 #include "DRTestIndication.h"
+#include "AddrGen.h"
+#include "TraceFile.h"
+#include "Bench.h"
+#include "AsyncLog.h"
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 class DRTestIndication;
 DRTestIndication *testInd = 0;
 DRTestRequestProxy *testReq = 0;
 
+// read latency histogram, same bucketing as mkLatHist in LatHist.bsv
+const int lat_hist_bucket_num = 256;
+
+// max latency of a bucket
+uint64_t getLatHistBucketMax(int bucket, int linear_shift) {
+    if(linear_shift >= 0) {
+        if(bucket == lat_hist_bucket_num - 1) {
+            return UINT64_MAX; // overflow bucket
+        }
+        return ((uint64_t(bucket) + 1) << linear_shift) - 1;
+    }
+    if(bucket < 8) {
+        return bucket;
+    }
+    int msb = (bucket >> 3) + 2;
+    uint64_t mantissa = bucket & 0x07;
+    return ((9 + mantissa) << (msb - 3)) - 1;
+}
+
+// number of test clients sharing DRAM, i.e., DRTestClientNum in DRTestIF.bsv
+#ifdef DRAM_ARB_CLIENT_NUM
+const int client_num = DRAM_ARB_CLIENT_NUM;
+#else
+const int client_num = 1;
+#endif
+
+// DRAM perf counters, same order as DramStatType in DRTestIF.bsv
+const char *dram_stat_name[] = {
+    "cache read hit",
+    "cache read miss",
+    "cache read MSHR hit",
+    "cache write hit",
+    "cache write miss",
+    "cache writeback",
+    "cache stall cycles",
+    "arbiter grants",
+    "arbiter stall cycles",
+    "arbiter read bytes",
+    "arbiter write bytes",
+    "controller busy cycles",
+    "controller reads",
+    "controller writes",
+    "controller forwards",
+    "controller forward stall cycles",
+    "controller write-after-read stall cycles",
+    "controller read limit stall cycles",
+    "controller read cmd stall cycles",
+    "controller write cmd stall cycles",
+    "controller write data stall cycles",
+    "controller read occupancy sum",
+    "controller write buffer combines",
+    "controller write buffer partial writes",
+    "controller write buffer filter hits",
+    "controller write buffer filter false positives",
+    "controller read addr buffer filter hits",
+    "controller read addr buffer filter false positives"
+};
+const int dram_stat_num = sizeof(dram_stat_name) / sizeof(dram_stat_name[0]);
 
 class DRTestIndication : public DRTestIndicationWrapper {
 private:
     sem_t sem;
-    unsigned int addr_num;
+    unsigned int addr_num; // per client
     long long unsigned total_test_num; // including init data & check
+    int lat_linear_shift; // -1: log2 histogram
+    uint64_t lat_hist[client_num][lat_hist_bucket_num];
+    // DRAM perf counters (only non-zero ones are sent)
+    uint64_t dram_stat[client_num][dram_stat_num];
+    // bandwidth (bytes/cycle) of each client
+    double bandwidth[client_num];
+    int done_num;
+    Bench *bench;
+
+    // latency at a percentile (upper bound of the bucket)
+    uint64_t getLatPercentile(int client, double pct, uint64_t rd_num, uint64_t lat_max) {
+        uint64_t rank = uint64_t(double(rd_num) * pct / 100.0);
+        if(rank >= rd_num) {
+            rank = rd_num - 1;
+        }
+        uint64_t cnt = 0;
+        for(int i = 0; i < lat_hist_bucket_num; i++) {
+            cnt += lat_hist[client][i];
+            if(cnt > rank) {
+                uint64_t lat = getLatHistBucketMax(i, lat_linear_shift);
+                return lat < lat_max ? lat : lat_max;
+            }
+        }
+        return lat_max;
+    }
+
+    bool checkClient(int client) {
+        if(client < 0 || client >= client_num) {
+            logPrint("ERROR: unknown client %d\n", client);
+            return false;
+        }
+        return true;
+    }
+
+    // message prefix of a client
+    std::string clientName(int client) {
+        return client_num > 1 ? "client " + std::to_string(client) + ": " : "";
+    }
+
+    static double getFalsePosRate(uint64_t false_pos, uint64_t hit) {
+        return hit == 0 ? 0 : double(false_pos) / double(hit);
+    }
+
+    void printDramStats(int client) {
+        const uint64_t *stat = dram_stat[client];
+        std::string name = clientName(client);
+        bool has_stat = false;
+        for(int i = 0; i < dram_stat_num; i++) {
+            if(stat[i] != 0) {
+                logPrint("INFO: %s%s: %llu\n", name.c_str(), dram_stat_name[i],
+                         (long long unsigned)stat[i]);
+                has_stat = true;
+            }
+        }
+        uint64_t rd_hit = stat[CacheReadHit] + stat[CacheReadMshrHit];
+        uint64_t rd = rd_hit + stat[CacheReadMiss];
+        uint64_t wr_hit = stat[CacheWriteHit];
+        uint64_t wr = wr_hit + stat[CacheWriteMiss];
+        if(has_stat && rd + wr > 0) {
+            logPrint("INFO: %scache hit rate: read %f, write %f, total %f\n",
+                     name.c_str(),
+                     rd > 0 ? double(rd_hit) / double(rd) : 0.0,
+                     wr > 0 ? double(wr_hit) / double(wr) : 0.0,
+                     double(rd_hit + wr_hit) / double(rd + wr));
+        }
+        if(stat[CtrlBusyCycles] > 0) {
+            logPrint("INFO: %scontroller: avg reads in flight %f (when busy)\n",
+                     name.c_str(),
+                     double(stat[CtrlRdOccupancy]) / double(stat[CtrlBusyCycles]));
+        }
+        if(stat[CtrlWrFilterHit] + stat[CtrlRdFilterHit] > 0) {
+            logPrint("INFO: %scontroller: filter false positive rate: "
+                     "write buffer %f, read addr buffer %f\n", name.c_str(),
+                     getFalsePosRate(stat[CtrlWrFilterFalsePos], stat[CtrlWrFilterHit]),
+                     getFalsePosRate(stat[CtrlRdFilterFalsePos], stat[CtrlRdFilterHit]));
+        }
+    }
+
+    // bandwidth share and Jain's fairness index of all clients
+    void printFairness() {
+        double sum = 0;
+        double sq_sum = 0;
+        for(int i = 0; i < client_num; i++) {
+            sum += bandwidth[i];
+            sq_sum += bandwidth[i] * bandwidth[i];
+        }
+        for(int i = 0; i < client_num; i++) {
+            logPrint("INFO: client %d: bandwidth %f bytes/cycle, share %f\n",
+                     i, bandwidth[i], sum > 0 ? bandwidth[i] / sum : 0.0);
+        }
+        double fairness = sq_sum > 0 ? sum * sum / (client_num * sq_sum) : 0.0;
+        logPrint("INFO: total bandwidth %f bytes/cycle, fairness index %f\n",
+                 sum, fairness);
+        bench->record("total_bw", sum, "bytes/cycle", true);
+        bench->record("fairness", fairness, "", true);
+    }
 
 public:
-    DRTestIndication(int id, int n_addr, long long unsigned n_test) :
+    DRTestIndication(int id, int n_addr, long long unsigned n_test, int lat_shift,
+                     Bench *b) :
         DRTestIndicationWrapper(id),
         addr_num(n_addr),
-        total_test_num(n_test + 2 * n_addr)
+        total_test_num(n_test + 2 * n_addr),
+        lat_linear_shift(lat_shift),
+        done_num(0),
+        bench(b)
     {
+        memset(lat_hist, 0, sizeof(lat_hist));
+        memset(dram_stat, 0, sizeof(dram_stat));
+        memset(bandwidth, 0, sizeof(bandwidth));
         sem_init(&sem, 0, 0);
     }
 
@@ -54,46 +221,120 @@ public:
         sem_destroy(&sem);
     }
 
-    virtual void inited(TestAddrIdx mask) {
-        fprintf(stderr, "INFO: initialized, addr idx mask = %x\n", (unsigned)mask);
+    virtual void inited(uint8_t client, TestAddrIdx mask) {
+        logPrint("INFO: %sinitialized, addr idx mask = %x\n",
+                 clientName(client).c_str(), (unsigned)mask);
         if(unsigned(mask) != addr_num - 1) {
-            fprintf(stderr, "ERROR: mask wrong, should be %d\n", addr_num - 1);
+            logPrint("ERROR: mask wrong, should be %d\n", addr_num - 1);
+            logFlush();
             exit(-1);
         }
     }
 
-    virtual void done(int pass, uint64_t elapTime, uint64_t rdLatSum, uint64_t rdNum) {
+    virtual void latHist(uint8_t client, uint16_t bucket, uint64_t cnt) {
+        if(checkClient(client)) {
+            lat_hist[client][bucket] = cnt;
+        }
+    }
+
+    virtual void dramStat(uint8_t client, DramStatType t, uint64_t cnt) {
+        if(checkClient(client) && int(t) < dram_stat_num) {
+            dram_stat[client][t] = cnt;
+        }
+    }
+
+    virtual void done(uint8_t client, int pass, uint64_t elapTime,
+                      uint64_t rdLatSum, uint64_t rdNum,
+                      uint64_t rdLatMin, uint64_t rdLatMax) {
+        if(!checkClient(client)) {
+            return;
+        }
+        std::string name = clientName(client);
         double tp =  double(total_test_num) / double(elapTime);
         double lat = double(rdLatSum) / double(rdNum);
-        fprintf(stderr, "INFO: done: %s, "
-                "elapTime %llu, rdLatSum %llu, rdNum %llu, "
-                "total test num %llu, throughput %f data/cycle, "
-                "latency %f cycles\n",
-                pass ? "PASS" : "FAIL",
-                (long long unsigned)elapTime, (long long unsigned)rdLatSum,
-                (long long unsigned)rdNum, total_test_num, tp, lat);
-        sem_post(&sem);
-    }
-
-    virtual void testErr(uint64_t rdNum) {
-        fprintf(stderr, "ERROR: test err at read %llu\n", (long long unsigned)rdNum);
+        logPrint("INFO: %sdone: %s, "
+                 "elapTime %llu, rdLatSum %llu, rdNum %llu, "
+                 "total test num %llu, throughput %f data/cycle, "
+                 "latency %f cycles\n",
+                 name.c_str(), pass ? "PASS" : "FAIL",
+                 (long long unsigned)elapTime, (long long unsigned)rdLatSum,
+                 (long long unsigned)rdNum, total_test_num, tp, lat);
+        std::string metric = client_num > 1 ? "client" + std::to_string(client) + "_" : "";
+        bench->record(metric + "throughput", tp, "data/cycle", true);
+        if(rdNum > 0) {
+            bench->record(metric + "rd_lat", lat, "cycles", false);
+        }
+        uint64_t hist_num = 0;
+        for(int i = 0; i < lat_hist_bucket_num; i++) {
+            hist_num += lat_hist[client][i];
+        }
+        if(hist_num != rdNum) {
+            logPrint("ERROR: %slatency histogram has %llu reads, should be %llu\n",
+                     name.c_str(), (long long unsigned)hist_num, (long long unsigned)rdNum);
+        }
+        else if(rdNum > 0) {
+            logPrint("INFO: %sread latency (%s histogram): min %llu, "
+                     "p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu cycles\n",
+                     name.c_str(), lat_linear_shift < 0 ? "log2" : "linear",
+                     (long long unsigned)rdLatMin,
+                     (long long unsigned)getLatPercentile(client, 50, rdNum, rdLatMax),
+                     (long long unsigned)getLatPercentile(client, 90, rdNum, rdLatMax),
+                     (long long unsigned)getLatPercentile(client, 99, rdNum, rdLatMax),
+                     (long long unsigned)getLatPercentile(client, 99.9, rdNum, rdLatMax),
+                     (long long unsigned)rdLatMax);
+            bench->record(metric + "rd_lat_p99",
+                          getLatPercentile(client, 99, rdNum, rdLatMax), "cycles", false);
+        }
+        printDramStats(client);
+        bandwidth[client] = double(dram_stat[client][ArbRdBytes] +
+                                   dram_stat[client][ArbWrBytes]) / double(elapTime);
+        done_num++;
+        if(done_num == client_num) {
+            if(client_num > 1) {
+                printFairness();
+            }
+            sem_post(&sem);
+        }
+    }
+
+    virtual void testErr(uint8_t client, uint64_t rdNum) {
+        logPrint("ERROR: %stest err at read %llu\n",
+                 clientName(client).c_str(), (long long unsigned)rdNum);
         //exit(-1);
     }
 
     virtual void dramErr(uint8_t e) {
-        fprintf(stderr, "ERROR: dram err %d\n", (int)e);
+        logPrint("ERROR: dram err %d\n", (int)e);
         //exit(-1);
     }
 
     void waitDone() {
         sem_wait(&sem);
+        logFlush();
     }
 };
 
 void usage(char *prog) {
-    fprintf(stderr, "Usage: %s LOG_ADDR_NUM TEST_NUM SEND_STALL RECV_STALL\n", prog);
+    fprintf(stderr, "Usage: %s LOG_ADDR_NUM TEST_NUM SEND_STALL RECV_STALL "
+            "[PATTERN [LAT_BUCKET_SHIFT]]\n", prog);
+    fprintf(stderr, "       %s trace TRACE_FILE [PACE [LAT_BUCKET_SHIFT]]\n", prog);
+    fprintf(stderr, "PATTERN of test addrs:\n"
+            "  unique   : random distinct lines (default)\n"
+            "  bank     : same row in different banks\n"
+            "  conflict : different rows in the same bank\n"
+            "  stripe   : sequential lines striped across channels "
+            "(a single channel sees a sequential stream)\n");
+    fprintf(stderr, "trace mode replays TRACE_FILE (see TraceFile.h) in all clients, "
+            "PACE: 1 to keep the delays between reqs in trace, 0 (default) to issue "
+            "at full rate\n");
+    fprintf(stderr, "LOG_ADDR_NUM and TEST_NUM are per test client\n");
+    fprintf(stderr, "LAT_BUCKET_SHIFT: -1 (default) for log2 latency histogram, "
+            "or k >= 0 for linear histogram with bucket width 2^k\n");
 }
 
+// number of addrs in each setupAddrs call, i.e., AddrBatchSz in DRTestIF.bsv
+const int addr_batch_size = 8;
+
 unsigned int getSeed() {
     while(1) {
         int r = rand();
@@ -103,14 +344,111 @@ unsigned int getSeed() {
     }
 }
 
-bool isBadAddr(unsigned int exist_addr, unsigned new_addr) {
-    return exist_addr == new_addr;
-    // alternative: not same row+bank
-    //return (exist_addr >> 7) == (new_addr >> 7);
+// number of reqs in each traceReqs call, i.e., TraceBatchSz in DRTestIF.bsv
+const int trace_batch_size = 8;
+// records decoded at a time by the trace producer thread
+const size_t trace_chunk_size = 1 << 16;
+
+int runTrace(int argc, char *argv[]) {
+    if(argc < 3 || argc > 5) {
+        usage(argv[0]);
+        return 0;
+    }
+    bool paced = argc >= 4 && atoi(argv[3]) != 0;
+    int lat_shift = -1;
+    if(argc >= 5) {
+        lat_shift = atoi(argv[4]);
+        if(lat_shift < -1 || lat_shift > 31) {
+            fprintf(stderr, "LAT_BUCKET_SHIFT must be in [-1, 31]\n");
+            return 0;
+        }
+    }
+
+    const DramGeometry &geo = getDramGeometry();
+    TraceFile trace;
+    if(!trace.open(argv[2], uint64_t(1) << geo.addrBits())) {
+        return 0;
+    }
+    long long unsigned test_num = trace.size();
+    if(test_num == 0) {
+        fprintf(stderr, "trace has no record\n");
+        return 0;
+    }
+    fprintf(stderr, "INFO: client num %d, trace %s in %s, %llu reqs, %s data, %s\n",
+            client_num, argv[2], geo.name, test_num,
+            trace.hasData() ? "with" : "no", paced ? "paced" : "full rate");
+
+    // HW test cannot restart, so bench has a single run
+    Bench bench("DramRandTest", false);
+    testInd = new DRTestIndication(IfcNames_DRTestIndicationH2S, 0, test_num, lat_shift,
+                                   &bench);
+    testReq = new DRTestRequestProxy(IfcNames_DRTestRequestS2H);
+
+    // all clients replay the same trace
+    testReq->setup(-1, Client);
+    testReq->setup(test_num, TestNum);
+    if(lat_shift >= 0) {
+        testReq->setup(lat_shift, LatHistLinear);
+    }
+    testReq->setup((trace.hasData() ? 1 : 0) | (paced ? 2 : 0), Trace);
+    testReq->setup(0, Start);
+
+    // stream trace: each batch of reqs is followed by the data of its writes
+    trace.start(trace_chunk_size);
+    uint64_t sent = 0;
+    while(true) {
+        const std::vector<TraceEntry> &chunk = trace.next();
+        if(chunk.empty()) {
+            break;
+        }
+        for(size_t i = 0; i < chunk.size(); i += trace_batch_size) {
+            bsvvector_LTraceReq_L8 batch;
+            int num = chunk.size() - i < trace_batch_size ? chunk.size() - i : trace_batch_size;
+            for(int j = 0; j < trace_batch_size; j++) {
+                if(j < num) {
+                    const TraceEntry &e = chunk[i + j];
+                    batch[j].addr = e.line;
+                    batch[j].delay = e.delay;
+                    batch[j].be = e.be;
+                }
+                else {
+                    memset(&batch[j], 0, sizeof(batch[j]));
+                }
+            }
+            testReq->traceReqs(batch, num);
+            for(int j = 0; j < num; j++) {
+                const TraceEntry &e = chunk[i + j];
+                if(e.be != 0 && e.data) {
+                    bsvvector_Luint64_t_L8 data;
+                    memcpy(data, e.data, sizeof(data));
+                    testReq->traceData(data);
+                }
+            }
+        }
+        sent += chunk.size();
+    }
+    if(trace.failed()) {
+        fprintf(stderr, "ERROR: trace record %llu is beyond %s\n",
+                (long long unsigned)sent, geo.name);
+        exit(-1);
+    }
+    if(trace.clampedDelays() > 0) {
+        fprintf(stderr, "WARNING: %llu delays saturated to %d cycles\n",
+                (long long unsigned)trace.clampedDelays(), UINT16_MAX);
+    }
+
+    fprintf(stderr, "INFO: trace all sent, start waiting...\n");
+    testInd->waitDone();
+    fprintf(stderr, "INFO: all done\n");
+
+    return bench.finish();
 }
 
 int main(int argc, char *argv[]) {
-    if(argc != 5) {
+    if(argc >= 2 && strcmp(argv[1], "trace") == 0) {
+        return runTrace(argc, argv);
+    }
+    if(argc < 5 || argc > 7) {
         usage(argv[0]);
         return 0;
     }
@@ -138,61 +476,84 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "recv_stall must be in [0, %d]\n", max_stall);
         return 0;
     }
+    AddrPattern addr_pattern = UniqueLines;
+    if(argc >= 6 && !parseAddrPattern(argv[5], addr_pattern)) {
+        usage(argv[0]);
+        return 0;
+    }
+    int lat_shift = -1;
+    if(argc >= 7) {
+        lat_shift = atoi(argv[6]);
+        if(lat_shift < -1 || lat_shift > 31) {
+            fprintf(stderr, "LAT_BUCKET_SHIFT must be in [-1, 31]\n");
+            return 0;
+        }
+    }
 
     // init randomizer
     srand(time(0));
 
-    // get random seeds
-    unsigned int data_seed = getSeed();
-    unsigned int be_seed = getSeed();
-    unsigned int idx_seed = getSeed();
-
-    fprintf(stderr, "INFO: addr num %d, test num %llu, data seed %x, be seed %x, idx seed %x, send stall %d/%d, recv stall %d/%d\n",
-            addr_num, test_num, data_seed, be_seed, idx_seed, send_stall, max_stall + 1, recv_stall, max_stall + 1);
-
-    // get addr
-    unsigned int *addr = new unsigned int[addr_num];
-    for(int i = 0; i < addr_num; i++) {
-        while(1) {
-            addr[i] = rand() & 0x00FFFFFF; // 24 bit addr
-            bool bad_addr = false;
-            for(int j = 0; j < i; j++) {
-                if(isBadAddr(addr[j], addr[i])) {
-                    bad_addr = true;
-                    break;
-                }
-            }
-            if(!bad_addr) {
-                break;
-            }
-        }
+    fprintf(stderr, "INFO: client num %d, addr num %d per client, test num %llu, "
+            "send stall %d/%d, recv stall %d/%d\n",
+            client_num, addr_num, test_num, send_stall, max_stall + 1, recv_stall, max_stall + 1);
+
+    // get addr: distinct for all clients
+    const DramGeometry &geo = getDramGeometry();
+    std::vector<uint32_t> addr;
+    unsigned int addr_seed = getSeed();
+    if(!genAddrs(geo, addr_pattern, uint64_t(addr_num) * client_num, addr_seed, addr)) {
+        fprintf(stderr, "ERROR: %s cannot hold %d addrs\n", geo.name, addr_num * client_num);
+        return 0;
     }
+    fprintf(stderr, "INFO: %s addrs in %s, addr seed %x\n",
+            getAddrPatternName(addr_pattern), geo.name, addr_seed);
     // write the addr to log
     FILE *fp_addr = fopen("addr.txt", "wt");
-    for(int i = 0; i < addr_num; i++) {
-        fprintf(fp_addr, "%06x\n", addr[i]);
-    }
+    writeAddrs(fp_addr, geo, addr);
     fclose(fp_addr);
 
     // cearte indication & req objects
-    testInd = new DRTestIndication(IfcNames_DRTestIndicationH2S, addr_num, test_num);
+    // HW test cannot restart, so bench has a single run
+    Bench bench("DramRandTest", false);
+    testInd = new DRTestIndication(IfcNames_DRTestIndicationH2S, addr_num, test_num, lat_shift,
+                                   &bench);
     testReq = new DRTestRequestProxy(IfcNames_DRTestRequestS2H);
 
-    // setup HW
+    // setup HW: common params for all clients
     testReq->setup(test_num, TestNum);
-    testReq->setup(data_seed, DataSeed);
-    testReq->setup(be_seed, BESeed);
-    testReq->setup(idx_seed, IdxSeed);
     testReq->setup(send_stall, SendStall);
     testReq->setup(recv_stall, RecvStall);
-    for(int i = 0; i < addr_num; i++) {
-        testReq->setup(addr[i], Addr);
+    if(lat_shift >= 0) {
+        testReq->setup(lat_shift, LatHistLinear);
+    }
+    // random seeds and addrs of each client
+    for(int c = 0; c < client_num; c++) {
+        unsigned int data_seed = getSeed();
+        unsigned int be_seed = getSeed();
+        unsigned int idx_seed = getSeed();
+        fprintf(stderr, "INFO: client %d: data seed %x, be seed %x, idx seed %x\n",
+                c, data_seed, be_seed, idx_seed);
+
+        testReq->setup(c, Client);
+        testReq->setup(data_seed, DataSeed);
+        testReq->setup(be_seed, BESeed);
+        testReq->setup(idx_seed, IdxSeed);
+        const uint32_t *client_addr = &addr[c * addr_num];
+        for(int i = 0; i < addr_num; i += addr_batch_size) {
+            bsvvector_Luint32_t_L8 batch;
+            int num = addr_num - i < addr_batch_size ? addr_num - i : addr_batch_size;
+            for(int j = 0; j < addr_batch_size; j++) {
+                batch[j] = j < num ? client_addr[i + j] : 0;
+            }
+            testReq->setupAddrs(batch, num);
+        }
     }
+    testReq->setup(-1, Client);
     testReq->setup(0, Start);
 
     fprintf(stderr, "INFO: start waiting...\n");
     testInd->waitDone();
     fprintf(stderr, "INFO: all done\n");
 
-    return 0;
+    return bench.finish();
 }
@@ -24,9 +24,13 @@
 #include "DSTestIndication.h"
 #include "DSTestRequest.h"
 #include "GeneratedTypes.h"
+#include "Bench.h"
+#include "AsyncLog.h"
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 
 class DSTestIndication;
 DSTestIndication *testInd = 0;
@@ -38,24 +42,84 @@ const char *ddr3_err_str[] = {
     "ReadCntUnderflow"
 };
 
+// DRAM size in 64B lines
+#if defined(TEST_AWSF1) && (!defined(BSIM) || defined(SIM_DRAM_SPARSE))
+const uint64_t dram_lines = 1ULL << 28; // 16GB
+#else
+const uint64_t dram_lines = 1ULL << 24; // 1GB
+#endif
+
+// DRAM controller perf counters, same order as DramPerfType in DramCommon.bsv
+const char *dram_perf_name[] = {
+    "busy cycles",
+    "reads",
+    "writes",
+    "forwards",
+    "forward stall cycles",
+    "write-after-read stall cycles",
+    "read limit stall cycles",
+    "read cmd stall cycles",
+    "write cmd stall cycles",
+    "write data stall cycles",
+    "read occupancy sum",
+    "write buffer combines",
+    "write buffer partial writes",
+    "write buffer filter hits",
+    "write buffer filter false positives",
+    "read addr buffer filter hits",
+    "read addr buffer filter false positives"
+};
+const int dram_perf_num = sizeof(dram_perf_name) / sizeof(dram_perf_name[0]);
+
+// results of a test
+struct DSTestResult {
+    uint64_t wr_time;
+    uint64_t rd_time;
+    uint64_t rd_lat_sum;
+    uint64_t rd_num;
+};
+
 class DSTestIndication : public DSTestIndicationWrapper {
 private:
     sem_t sem;
-    int test_num;
     int last_done_id;
-    const uint64_t req_num;
-    const uint64_t req_bytes;
+    uint64_t req_num; // reqs in each pass
+    uint64_t req_bytes;
     const uint32_t cycle_time;
+    bool verbose; // print each test
+    DSTestResult last_result;
+    // every done is recorded as a bench sample, metric names are prefixed to
+    // distinguish params in sweep
+    Bench *bench;
+    std::string metric_prefix;
+    // DRAM perf counters (cumulative) of current and previous done
+    uint64_t dram_perf[dram_perf_num];
+    uint64_t prev_dram_perf[dram_perf_num];
+
+    // print counters changed in last test
+    void printDramPerf() {
+        for(int i = 0; i < dram_perf_num; i++) {
+            uint64_t delta = dram_perf[i] - prev_dram_perf[i];
+            if(delta != 0) {
+                logPrint("      dram %s: %llu\n", dram_perf_name[i],
+                         (long long unsigned)delta);
+            }
+        }
+        memcpy(prev_dram_perf, dram_perf, sizeof(dram_perf));
+    }
 
 public:
-    DSTestIndication(int id) : 
+    DSTestIndication(int id, Bench *b) : 
         DSTestIndicationWrapper(id), 
-        test_num(-1), 
         last_done_id(-1),
-        req_num(1ULL << 24), // 24bit addr x 64B data
-        req_bytes(1ULL << 30), // 1GB data
-        cycle_time(USER_CLK_PERIOD) // cycle time in ns
+        req_num(0),
+        req_bytes(0),
+        cycle_time(USER_CLK_PERIOD), // cycle time in ns
+        verbose(true),
+        bench(b)
     {
+        memset(dram_perf, 0, sizeof(dram_perf));
+        memset(prev_dram_perf, 0, sizeof(prev_dram_perf));
         sem_init(&sem, 0, 0);
     }
 
@@ -63,80 +127,235 @@ public:
         sem_destroy(&sem);
     }
 
-    virtual void done(uint32_t testId, uint64_t wrTime, uint64_t rdTime, uint64_t rdLatSum) {
+    virtual void dramPerf(uint8_t t, uint64_t cnt) {
+        if(t < dram_perf_num) {
+            dram_perf[t] = cnt;
+        }
+    }
+
+    virtual void done(uint32_t testId, uint64_t wrTime, uint64_t rdTime,
+                      uint64_t rdLatSum, uint64_t rdNum) {
         if(int(testId) != (last_done_id + 1)) {
-            fprintf(stderr, "ERROR: expected done test id = %d, recv done id = %d\n",
-                    last_done_id + 1, (int)testId);
+            logPrint("ERROR: expected done test id = %d, recv done id = %d\n",
+                     last_done_id + 1, (int)testId);
+            logFlush();
             exit(-1);
         }
-        // throughput
-        double wr_tp = double(req_bytes) / double(wrTime * cycle_time);
-        double rd_tp = double(req_bytes) / double(rdTime * cycle_time);
-        // latency
-        double rd_lat = double(rdLatSum) / double(req_num);
-        fprintf(stderr, "INFO: done test %d: wrTime %llu, rdTime %llu, rdLatSum %llu\n", (int)testId, 
-                (long long unsigned)wrTime, (long long unsigned)rdTime, (long long unsigned)rdLatSum);
-        fprintf(stderr, "      wr throughput: %f GB/s\n", wr_tp);
-        fprintf(stderr, "      rd throughput: %f GB/s\n", rd_tp);
-        fprintf(stderr, "      rd latency: %f cycles * %d ns\n", rd_lat, (int)cycle_time);
+        last_result.wr_time = wrTime;
+        last_result.rd_time = rdTime;
+        last_result.rd_lat_sum = rdLatSum;
+        last_result.rd_num = rdNum;
+        bench->record(metric_prefix + "wr_bw", getBW(wrTime), "GB/s", true);
+        bench->record(metric_prefix + "rd_bw", getBW(rdTime), "GB/s", true);
+        if(rdNum > 0) {
+            bench->record(metric_prefix + "rd_lat", getRdLat(last_result), "cycles", false);
+        }
+        if(verbose) {
+            logPrint("INFO: done test %d: wrTime %llu, rdTime %llu, "
+                     "rdLatSum %llu, rdNum %llu\n", (int)testId,
+                     (long long unsigned)wrTime, (long long unsigned)rdTime,
+                     (long long unsigned)rdLatSum, (long long unsigned)rdNum);
+            logPrint("      1st pass (wr) throughput: %f GB/s\n", getBW(wrTime));
+            logPrint("      2nd pass (rd/wr) throughput: %f GB/s\n", getBW(rdTime));
+            logPrint("      rd latency: %f cycles * %d ns\n",
+                     getRdLat(last_result), (int)cycle_time);
+            printDramPerf();
+        }
+        else {
+            memcpy(prev_dram_perf, dram_perf, sizeof(dram_perf));
+        }
         // change state
         last_done_id++;
-        if(last_done_id == test_num - 1) {
-            sem_post(&sem);
-        }
+        sem_post(&sem);
     }
 
     virtual void readErr(uint32_t testId, uint32_t rdAddr) {
-        fprintf(stderr, "ERROR: test %d read %x\n", int(testId), (int)rdAddr);
+        logPrint("ERROR: test %d read %x\n", int(testId), (int)rdAddr);
+        logFlush();
         exit(-1);
     }
 
     virtual void dramErr(uint8_t e) {
         //fprintf(stderr, "ERROR: dram %s\n", e < 3 ? ddr3_err_str[e] : "unknown err");
-        fprintf(stderr, "ERROR: dram %d\n", (int)e);
+        logPrint("ERROR: dram %d\n", (int)e);
+        logFlush();
         exit(-1);
     }
 
     virtual void dramStatus(int init) {
-        fprintf(stderr, "INFO: dram status %d\n", init);
+        logPrint("INFO: dram status %d\n", init);
+    }
+
+    // prepare for a new start
+    void setTest(const DSTestParam &param, bool v, const std::string &prefix) {
+        last_done_id = -1;
+        req_num = (uint64_t(param.regionSz) + param.stride - 1) / param.stride;
+        req_bytes = req_num * 64;
+        verbose = v;
+        metric_prefix = prefix;
+    }
+
+    // bandwidth in GB/s of a pass
+    double getBW(uint64_t time) {
+        return time == 0 ? 0 : double(req_bytes) / double(time * cycle_time);
     }
 
-    void setTestNum(int num) {
-        test_num = num;
+    double getRdLat(const DSTestResult &r) {
+        return r.rd_num == 0 ? 0 : double(r.rd_lat_sum) / double(r.rd_num);
+    }
+
+    const DSTestResult &getLastResult() {
+        return last_result;
     }
 
     void waitDone() {
         sem_wait(&sem);
+        logFlush();
     }
 };
 
+DSTestParam getDefaultParam() {
+    DSTestParam param;
+    param.testNum = 1;
+    param.base = 0;
+    param.regionSz = 1 << 24; // 1GB
+    param.stride = 1;
+    param.wrRatio = 0;
+    param.maxRdNum = 0;
+    return param;
+}
+
+bool checkParam(const DSTestParam &param) {
+    if(param.testNum == 0 || param.stride == 0 || param.regionSz < param.stride) {
+        fprintf(stderr, "ERROR: need TEST_NUM > 0, STRIDE > 0, REGION >= STRIDE\n");
+        return false;
+    }
+    if(uint64_t(param.base) + param.regionSz > dram_lines) {
+        fprintf(stderr, "ERROR: BASE + REGION exceeds DRAM size %llu lines\n",
+                (long long unsigned)dram_lines);
+        return false;
+    }
+    if(param.wrRatio > 256) {
+        fprintf(stderr, "ERROR: WR_RATIO must be in [0, 256]\n");
+        return false;
+    }
+    return true;
+}
+
+// run all tests of a param and return the result of the last one
+DSTestResult runTest(const DSTestParam &param, bool verbose,
+                     const std::string &prefix = "") {
+    testInd->setTest(param, verbose, prefix);
+    testReq->start(param);
+    for(uint32_t i = 0; i < param.testNum; i++) {
+        testInd->waitDone();
+    }
+    return testInd->getLastResult();
+}
+
+// sweep stride and max in-flight reads
+void sweep(uint32_t region) {
+    DSTestParam param = getDefaultParam();
+    param.regionSz = region;
+
+    fprintf(stderr, "INFO: bandwidth vs stride, region %u lines, "
+            "1st pass all writes, 2nd pass all reads\n", region);
+    fprintf(stderr, "%12s %12s %12s %16s\n",
+            "stride(64B)", "wr GB/s", "rd GB/s", "rd lat(cycles)");
+    for(uint32_t stride = 1; stride <= 256 && stride <= region; stride *= 2) {
+        param.stride = stride;
+        DSTestResult r = runTest(param, false, "stride" + std::to_string(stride) + "_");
+        fprintf(stderr, "%12u %12.3f %12.3f %16.1f\n", stride,
+                testInd->getBW(r.wr_time), testInd->getBW(r.rd_time),
+                testInd->getRdLat(r));
+    }
+
+    param.stride = 1;
+    fprintf(stderr, "INFO: bandwidth vs max in-flight reads, region %u lines, "
+            "stride 1, 2nd pass all reads\n", region);
+    fprintf(stderr, "%12s %12s %16s\n", "max rd", "rd GB/s", "rd lat(cycles)");
+    for(uint32_t max_rd = 1; max_rd <= 1024; max_rd *= 2) {
+        // 1024 is the limit in HW, i.e., no limit
+        param.maxRdNum = max_rd == 1024 ? 0 : max_rd;
+        DSTestResult r = runTest(param, false, "max_rd" + std::to_string(max_rd) + "_");
+        fprintf(stderr, "%12u %12.3f %16.1f\n", max_rd,
+                testInd->getBW(r.rd_time), testInd->getRdLat(r));
+    }
+
+    param.maxRdNum = 0;
+    fprintf(stderr, "INFO: bandwidth vs write ratio, region %u lines, "
+            "stride 1, 2nd pass mixed reads & writes\n", region);
+    fprintf(stderr, "%12s %12s %16s\n", "wr/256", "rd+wr GB/s", "rd lat(cycles)");
+    for(uint32_t wr_ratio = 0; wr_ratio <= 256; wr_ratio += 64) {
+        param.wrRatio = wr_ratio;
+        DSTestResult r = runTest(param, false, "wr_ratio" + std::to_string(wr_ratio) + "_");
+        fprintf(stderr, "%12u %12.3f %16.1f\n", wr_ratio,
+                testInd->getBW(r.rd_time), testInd->getRdLat(r));
+    }
+}
+
 void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s TEST_NUM\n", prog);
+    fprintf(stderr, "Usage: %s TEST_NUM [BASE REGION STRIDE [WR_RATIO [MAX_RD]]]\n"
+            "       %s sweep [REGION]\n", prog, prog);
+    fprintf(stderr, "BASE, REGION, STRIDE are in 64B lines "
+            "(default 0, 2^24, 1)\n"
+            "WR_RATIO: writes per 256 accesses in 2nd pass (default 0)\n"
+            "MAX_RD: max in-flight reads in 2nd pass (default 0, no limit)\n");
 }
 
 int main(int argc, char *argv[]) {
-    if(argc != 2) {
+    bool do_sweep = argc >= 2 && std::string(argv[1]) == "sweep";
+    if(argc < 2 || argc > 7 || (do_sweep && argc > 3) ||
+       (!do_sweep && argc > 2 && argc < 5)) {
         usage(argv[0]);
         return 0;
     }
 
-    int test_num = atoi(argv[1]);
-    if(test_num <= 0) {
+    DSTestParam param = getDefaultParam();
+    if(do_sweep) {
+        if(argc == 3) {
+            param.regionSz = strtoul(argv[2], 0, 0);
+        }
+    }
+    else {
+        param.testNum = strtoul(argv[1], 0, 0);
+        if(argc >= 5) {
+            param.base = strtoul(argv[2], 0, 0);
+            param.regionSz = strtoul(argv[3], 0, 0);
+            param.stride = strtoul(argv[4], 0, 0);
+        }
+        if(argc >= 6) {
+            param.wrRatio = strtoul(argv[5], 0, 0);
+        }
+        if(argc >= 7) {
+            param.maxRdNum = strtoul(argv[6], 0, 0);
+        }
+    }
+    if(!checkParam(param)) {
         usage(argv[0]);
         return 0;
     }
 
-    fprintf(stderr, "INFO: test num = %d\n", test_num);
+    Bench bench(do_sweep ? "DramSeqTest_sweep" : "DramSeqTest");
 
-    testInd = new DSTestIndication(IfcNames_DSTestIndicationH2S);
+    testInd = new DSTestIndication(IfcNames_DSTestIndicationH2S, &bench);
     testReq = new DSTestRequestProxy(IfcNames_DSTestRequestS2H);
-    // set test num
-    testInd->setTestNum(test_num);
-    // start test & wait
-    testReq->start(test_num);
-    fprintf(stderr, "INFO: waiting...\n");
-    testInd->waitDone();
+
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        if(do_sweep) {
+            sweep(param.regionSz);
+        }
+        else {
+            fprintf(stderr, "INFO: test num %u, base %u, region %u, stride %u, "
+                    "wr ratio %u/256, max rd %u\n",
+                    param.testNum, param.base, param.regionSz, param.stride,
+                    param.wrRatio, param.maxRdNum);
+            fprintf(stderr, "INFO: waiting...\n");
+            runTest(param, true);
+        }
+    }
     fprintf(stderr, "INFO: all done\n");
 
-    return 0;
+    return bench.finish();
 }
@@ -0,0 +1,341 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "HostFpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fenv.h>
+#include <immintrin.h>
+
+// marks an excep that SIMD cannot decide, the op needs to be redone in scalar
+static const uint8_t FpExcepUnknown = 0x80;
+
+// SIMD results are exact when all non-zero operands are within this range
+static const double simd_min = ldexp(1.0, -400);
+static const double simd_max = ldexp(1.0, 400);
+
+static inline uint64_t packDouble(double fp) {
+    uint64_t bin;
+    memcpy(&bin, &fp, sizeof(double));
+    return bin;
+}
+
+static inline double unpackDouble(uint64_t bin) {
+    double fp;
+    memcpy(&fp, &bin, sizeof(double));
+    return fp;
+}
+
+template<typename T>
+static T *allocAligned(size_t n) {
+    void *p = 0;
+    if(posix_memalign(&p, 64, n * sizeof(T)) != 0) {
+        fprintf(stderr, "ERROR: HostFpu fail to alloc %zu bytes\n", n * sizeof(T));
+        exit(-1);
+    }
+    return (T*)p;
+}
+
+HostFpu::HostFpu(size_t max_num) : capacity(max_num), num(0) {
+    a = allocAligned<double>(capacity);
+    b = allocAligned<double>(capacity);
+    c = allocAligned<double>(capacity);
+    fma_res = allocAligned<double>(capacity);
+    div_res = allocAligned<double>(capacity);
+    sqrt_res = allocAligned<double>(capacity);
+    fma_excep = allocAligned<uint8_t>(capacity);
+    div_excep = allocAligned<uint8_t>(capacity);
+    sqrt_excep = allocAligned<uint8_t>(capacity);
+}
+
+HostFpu::~HostFpu() {
+    free(a);
+    free(b);
+    free(c);
+    free(fma_res);
+    free(div_res);
+    free(sqrt_res);
+    free(fma_excep);
+    free(div_excep);
+    free(sqrt_excep);
+}
+
+size_t HostFpu::add(bool a_valid, uint64_t a_data, uint64_t b_data, uint64_t c_data) {
+    size_t i = num;
+    a[i] = a_valid ? unpackDouble(a_data) : -0.0;
+    b[i] = unpackDouble(b_data);
+    c[i] = unpackDouble(c_data);
+    num++;
+    return i;
+}
+
+uint64_t HostFpu::fma(size_t i) const {
+    return packDouble(fma_res[i]);
+}
+
+uint64_t HostFpu::div(size_t i) const {
+    return packDouble(div_res[i]);
+}
+
+uint64_t HostFpu::sqrt(size_t i) const {
+    return packDouble(sqrt_res[i]);
+}
+
+// x86 flags of the last op
+static inline void clearExcep() {
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+static inline uint8_t getExcep() {
+    int e = fetestexcept(FE_ALL_EXCEPT);
+    uint8_t excep = 0;
+    if(e & FE_INEXACT) excep |= FpExcepInexact;
+    if(e & FE_UNDERFLOW) excep |= FpExcepUnderflow;
+    if(e & FE_OVERFLOW) excep |= FpExcepOverflow;
+    if(e & FE_DIVBYZERO) excep |= FpExcepDivZero;
+    if(e & FE_INVALID) excep |= FpExcepInvalid;
+    return excep;
+}
+
+// volatile keeps each op between clearing and reading the flags
+void HostFpu::computeScalar(size_t i) {
+    volatile double va = a[i];
+    volatile double vb = b[i];
+    volatile double vc = c[i];
+    volatile double res;
+    if(fma_excep[i] == FpExcepUnknown) {
+        clearExcep();
+        res = ::fma(vb, vc, va);
+        fma_excep[i] = getExcep();
+        fma_res[i] = res;
+    }
+    if(div_excep[i] == FpExcepUnknown) {
+        clearExcep();
+        res = vb / vc;
+        div_excep[i] = getExcep();
+        div_res[i] = res;
+    }
+    if(sqrt_excep[i] == FpExcepUnknown) {
+        clearExcep();
+        res = ::sqrt(vc);
+        sqrt_excep[i] = getExcep();
+        sqrt_res[i] = res;
+    }
+}
+
+// SIMD kernels
+//
+// For an operand range without underflow/overflow, results are never
+// invalid, divide by 0, overflow or underflow. The inexact flag is set iff
+// the exact error of the op is non-zero:
+// - div: q = RN(b / c), error = b - q * c = fma(-q, c, b) exactly
+// - sqrt: s = RN(sqrt(c)), error = c - s * s = fma(-s, s, c) exactly
+// - fma: r = RN(a + b * c), error = a + b * c - r = r2 + r3 computed by
+//   ErrFma (Boldo and Muller, "Exact and approximated error of the FMA"),
+//   and r2 == 0 iff r2 + r3 == 0.
+
+// write excep of a group of lanes
+static inline void setExcep(uint8_t *excep, int lanes, unsigned easy, unsigned inexact) {
+    for(int k = 0; k < lanes; k++) {
+        if((easy >> k) & 1) {
+            excep[k] = (inexact >> k) & 1 ? FpExcepInexact : 0;
+        }
+        else {
+            excep[k] = FpExcepUnknown;
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d twoSum256(__m256d x, __m256d y, __m256d &err) {
+    __m256d s = _mm256_add_pd(x, y);
+    __m256d yy = _mm256_sub_pd(s, x);
+    __m256d xx = _mm256_sub_pd(s, yy);
+    err = _mm256_add_pd(_mm256_sub_pd(x, xx), _mm256_sub_pd(y, yy));
+    return s;
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d inRange256(__m256d x, __m256d lo, __m256d hi, __m256d abs_mask) {
+    __m256d abs_x = _mm256_and_pd(x, abs_mask);
+    return _mm256_and_pd(_mm256_cmp_pd(abs_x, lo, _CMP_GE_OQ),
+                         _mm256_cmp_pd(abs_x, hi, _CMP_LE_OQ));
+}
+
+// return number of inputs computed
+__attribute__((target("avx2,fma")))
+static size_t computeAvx2(
+    size_t num, const double *a, const double *b, const double *c,
+    double *fma_res, double *div_res, double *sqrt_res,
+    uint8_t *fma_excep, uint8_t *div_excep, uint8_t *sqrt_excep
+) {
+    const __m256d lo = _mm256_set1_pd(simd_min);
+    const __m256d hi = _mm256_set1_pd(simd_max);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+    size_t i = 0;
+    for(; i + 4 <= num; i += 4) {
+        __m256d va = _mm256_load_pd(a + i);
+        __m256d vb = _mm256_load_pd(b + i);
+        __m256d vc = _mm256_load_pd(c + i);
+        __m256d b_ok = inRange256(vb, lo, hi, abs_mask);
+        __m256d c_ok = inRange256(vc, lo, hi, abs_mask);
+        __m256d bc_ok = _mm256_and_pd(b_ok, c_ok);
+
+        // fma
+        __m256d r1 = _mm256_fmadd_pd(vb, vc, va);
+        __m256d u1 = _mm256_mul_pd(vb, vc);
+        __m256d u2 = _mm256_fmsub_pd(vb, vc, u1);
+        __m256d alpha2, beta2;
+        __m256d alpha1 = twoSum256(va, u2, alpha2);
+        __m256d beta1 = twoSum256(u1, alpha1, beta2);
+        __m256d gamma = _mm256_add_pd(_mm256_sub_pd(beta1, r1), beta2);
+        __m256d fma_err = _mm256_add_pd(gamma, alpha2);
+        __m256d a_ok = _mm256_or_pd(_mm256_cmp_pd(va, zero, _CMP_EQ_OQ),
+                                    inRange256(va, lo, hi, abs_mask));
+        _mm256_store_pd(fma_res + i, r1);
+        setExcep(fma_excep + i, 4,
+                 _mm256_movemask_pd(_mm256_and_pd(a_ok, bc_ok)),
+                 _mm256_movemask_pd(_mm256_cmp_pd(fma_err, zero, _CMP_NEQ_UQ)));
+
+        // div
+        __m256d q = _mm256_div_pd(vb, vc);
+        __m256d div_err = _mm256_fnmadd_pd(q, vc, vb);
+        _mm256_store_pd(div_res + i, q);
+        setExcep(div_excep + i, 4, _mm256_movemask_pd(bc_ok),
+                 _mm256_movemask_pd(_mm256_cmp_pd(div_err, zero, _CMP_NEQ_UQ)));
+
+        // sqrt
+        __m256d s = _mm256_sqrt_pd(vc);
+        __m256d sqrt_err = _mm256_fnmadd_pd(s, s, vc);
+        __m256d c_pos = _mm256_and_pd(_mm256_cmp_pd(vc, lo, _CMP_GE_OQ),
+                                      _mm256_cmp_pd(vc, hi, _CMP_LE_OQ));
+        _mm256_store_pd(sqrt_res + i, s);
+        setExcep(sqrt_excep + i, 4, _mm256_movemask_pd(c_pos),
+                 _mm256_movemask_pd(_mm256_cmp_pd(sqrt_err, zero, _CMP_NEQ_UQ)));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d twoSum512(__m512d x, __m512d y, __m512d &err) {
+    __m512d s = _mm512_add_pd(x, y);
+    __m512d yy = _mm512_sub_pd(s, x);
+    __m512d xx = _mm512_sub_pd(s, yy);
+    err = _mm512_add_pd(_mm512_sub_pd(x, xx), _mm512_sub_pd(y, yy));
+    return s;
+}
+
+__attribute__((target("avx512f")))
+static inline __mmask8 inRange512(__m512d x, __m512d lo, __m512d hi) {
+    __m512d abs_x = _mm512_abs_pd(x);
+    return _mm512_cmp_pd_mask(abs_x, lo, _CMP_GE_OQ) &
+           _mm512_cmp_pd_mask(abs_x, hi, _CMP_LE_OQ);
+}
+
+__attribute__((target("avx512f")))
+static size_t computeAvx512(
+    size_t num, const double *a, const double *b, const double *c,
+    double *fma_res, double *div_res, double *sqrt_res,
+    uint8_t *fma_excep, uint8_t *div_excep, uint8_t *sqrt_excep
+) {
+    const __m512d lo = _mm512_set1_pd(simd_min);
+    const __m512d hi = _mm512_set1_pd(simd_max);
+    const __m512d zero = _mm512_setzero_pd();
+    size_t i = 0;
+    for(; i + 8 <= num; i += 8) {
+        __m512d va = _mm512_load_pd(a + i);
+        __m512d vb = _mm512_load_pd(b + i);
+        __m512d vc = _mm512_load_pd(c + i);
+        __mmask8 bc_ok = inRange512(vb, lo, hi) & inRange512(vc, lo, hi);
+
+        // fma
+        __m512d r1 = _mm512_fmadd_pd(vb, vc, va);
+        __m512d u1 = _mm512_mul_pd(vb, vc);
+        __m512d u2 = _mm512_fmsub_pd(vb, vc, u1);
+        __m512d alpha2, beta2;
+        __m512d alpha1 = twoSum512(va, u2, alpha2);
+        __m512d beta1 = twoSum512(u1, alpha1, beta2);
+        __m512d gamma = _mm512_add_pd(_mm512_sub_pd(beta1, r1), beta2);
+        __m512d fma_err = _mm512_add_pd(gamma, alpha2);
+        __mmask8 a_ok = _mm512_cmp_pd_mask(va, zero, _CMP_EQ_OQ) |
+                        inRange512(va, lo, hi);
+        _mm512_store_pd(fma_res + i, r1);
+        setExcep(fma_excep + i, 8, a_ok & bc_ok,
+                 _mm512_cmp_pd_mask(fma_err, zero, _CMP_NEQ_UQ));
+
+        // div
+        __m512d q = _mm512_div_pd(vb, vc);
+        __m512d div_err = _mm512_fnmadd_pd(q, vc, vb);
+        _mm512_store_pd(div_res + i, q);
+        setExcep(div_excep + i, 8, bc_ok,
+                 _mm512_cmp_pd_mask(div_err, zero, _CMP_NEQ_UQ));
+
+        // sqrt
+        __m512d s = _mm512_sqrt_pd(vc);
+        __m512d sqrt_err = _mm512_fnmadd_pd(s, s, vc);
+        __mmask8 c_pos = _mm512_cmp_pd_mask(vc, lo, _CMP_GE_OQ) &
+                         _mm512_cmp_pd_mask(vc, hi, _CMP_LE_OQ);
+        _mm512_store_pd(sqrt_res + i, s);
+        setExcep(sqrt_excep + i, 8, c_pos,
+                 _mm512_cmp_pd_mask(sqrt_err, zero, _CMP_NEQ_UQ));
+    }
+    return i;
+}
+
+void HostFpu::compute() {
+    // default rounding mode and no flush to zero
+    fenv_t env;
+    feholdexcept(&env);
+    fesetround(FE_TONEAREST);
+    unsigned csr = _mm_getcsr();
+    _mm_setcsr(csr & ~0x8040); // clear FTZ and DAZ
+
+    size_t i = 0;
+    if(__builtin_cpu_supports("avx512f")) {
+        i = computeAvx512(num, a, b, c, fma_res, div_res, sqrt_res,
+                          fma_excep, div_excep, sqrt_excep);
+    }
+    else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        i = computeAvx2(num, a, b, c, fma_res, div_res, sqrt_res,
+                        fma_excep, div_excep, sqrt_excep);
+    }
+    // remaining inputs
+    for(; i < num; i++) {
+        fma_excep[i] = FpExcepUnknown;
+        div_excep[i] = FpExcepUnknown;
+        sqrt_excep[i] = FpExcepUnknown;
+    }
+    // redo ops that SIMD cannot decide
+    for(i = 0; i < num; i++) {
+        if(((fma_excep[i] | div_excep[i] | sqrt_excep[i]) & FpExcepUnknown) != 0) {
+            computeScalar(i);
+        }
+    }
+
+    _mm_setcsr(csr);
+    fesetenv(&env);
+}
+
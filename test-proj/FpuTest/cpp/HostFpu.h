@@ -0,0 +1,86 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// exception flags, same bit order as pack(FloatingPoint::Exception)
+const uint8_t FpExcepInexact = 1 << 0;
+const uint8_t FpExcepUnderflow = 1 << 1;
+const uint8_t FpExcepOverflow = 1 << 2;
+const uint8_t FpExcepDivZero = 1 << 3;
+const uint8_t FpExcepInvalid = 1 << 4;
+const uint8_t FpExcepAll = 0x1F;
+
+// Reference FPU in x86: computes a + b * c, b / c and sqrt(c) with round to
+// nearest even and IEEE exception flags (tininess detected after rounding,
+// like x86), bit-exactly.
+//
+// Inputs are collected into a batch, and the whole batch is computed at once.
+// Data are kept in separate arrays, so AVX-512 or AVX2 is used when the CPU
+// supports it. In SIMD, the inexact flag is derived from the exact error of
+// each op, which is only valid when no underflow/overflow can happen. The few
+// inputs outside that range are recomputed one by one with x86 flags.
+class HostFpu {
+public:
+    HostFpu(size_t max_num);
+    ~HostFpu();
+
+    size_t size() const { return num; }
+    bool full() const { return num == capacity; }
+    void clear() { num = 0; }
+
+    // add an input to batch, and return its index
+    size_t add(bool a_valid, uint64_t a_data, uint64_t b_data, uint64_t c_data);
+
+    // compute all inputs in batch
+    void compute();
+
+    // results (after compute)
+    uint64_t fma(size_t i) const;
+    uint64_t div(size_t i) const;
+    uint64_t sqrt(size_t i) const;
+    uint8_t fmaExcep(size_t i) const { return fma_excep[i]; }
+    uint8_t divExcep(size_t i) const { return div_excep[i]; }
+    uint8_t sqrtExcep(size_t i) const { return sqrt_excep[i]; }
+
+private:
+    size_t capacity;
+    size_t num;
+    // inputs: a is -0 when invalid, so that a + b * c == b * c exactly
+    double *a;
+    double *b;
+    double *c;
+    // outputs
+    double *fma_res;
+    double *div_res;
+    double *sqrt_res;
+    uint8_t *fma_excep;
+    uint8_t *div_excep;
+    uint8_t *sqrt_excep;
+
+    void computeScalar(size_t i);
+};
+
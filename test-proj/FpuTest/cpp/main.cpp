@@ -24,13 +24,21 @@
 #include "FpuTestIndication.h"
 #include "FpuTestRequest.h"
 #include "GeneratedTypes.h"
+#include "HostFpu.h"
+#include "Bench.h"
+#include "AsyncLog.h"
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
 #include <random>
+#include <vector>
 
-TestReq curReq; // req sent to FPGA
+// reqs sent to FPGA, indexed by tag
+const uint32_t tag_num = 1 << TEST_TAG_SIZE;
+TestReq all_req[tag_num];
 
 // pack & unpack double
 uint64_t inline packDouble(const double fp) {
@@ -44,134 +52,559 @@ double inline unpackDouble(const uint64_t bin) {
     return fp;
 }
 
-// get results in x86
-void hostFpu(Result &result) {
+// FPU ops under test
+enum FpuOp { FmaOp, DivOp, SqrtOp, FpuOpNum };
+const char *fpu_op_name[FpuOpNum] = {"fma", "div", "sqrt"};
+
+// FPU implementations under test
+enum FpuImpl { XilinxImpl, BluespecImpl, FpuImplNum };
+const char *fpu_impl_name[FpuImplNum] = {"xilinx", "bluespec"};
+
+// exception flags checked for each implementation
+#ifdef BSIM
+// simulation models of xilinx IP do not report any exception
+const uint8_t xilinx_excep_mask[FpuOpNum] = {0, 0, 0};
+#else
+const uint8_t xilinx_excep_mask[FpuOpNum] = {
+    FpExcepInvalid | FpExcepOverflow | FpExcepUnderflow,
+    FpExcepInvalid | FpExcepDivZero | FpExcepOverflow | FpExcepUnderflow,
+    FpExcepInvalid
+};
+#endif
+const uint8_t bluespec_excep_mask[FpuOpNum] = {FpExcepAll, FpExcepAll, FpExcepAll};
+
+#ifdef BSIM
+// simulation model of xilinx fma (xilinx/fpu/fp_fma_sim.v) is not fused: it
+// rounds b * c before adding a, and invalid a is +0
+uint64_t unfusedFma(const TestReq &req) {
+    volatile double prod = unpackDouble(req.b) * unpackDouble(req.c); // no contraction
+    double a = req.a_valid ? unpackDouble(req.a_data) : 0.0;
+    return packDouble(prod + a);
+}
+#endif
+
+// ULP histogram: bucket 0 counts exact matches, bucket k (k > 0) counts ULP
+// differences in [2^(k-1), 2^k)
+const int ulp_bucket_num = 65;
+
+// map double bits to an integer with the same order
+int64_t inline orderedDouble(const uint64_t bin) {
+    int64_t mag = int64_t(bin & 0x7FFFFFFFFFFFFFFFULL);
+    return (bin >> 63) ? -mag - 1 : mag;
+}
+
+bool inline isNaN(const uint64_t bin) {
+    return (bin & 0x7FFFFFFFFFFFFFFFULL) > 0x7FF0000000000000ULL;
+}
+
+int getUlpBucket(const uint64_t x, const uint64_t y) {
+    // any NaN matches NaN
+    if(isNaN(x) || isNaN(y)) {
+        return isNaN(x) && isNaN(y) ? 0 : ulp_bucket_num - 1;
+    }
+    int64_t ox = orderedDouble(x);
+    int64_t oy = orderedDouble(y);
+    uint64_t ulp = ox > oy ? uint64_t(ox) - uint64_t(oy) : uint64_t(oy) - uint64_t(ox);
+    return ulp == 0 ? 0 : 64 - __builtin_clzll(ulp);
+}
+
+// stats of an op in an implementation
+struct OpStats {
+    uint64_t data_err; // data mismatches
+    uint64_t excep_err; // exception mismatches
+    uint64_t ulp_hist[ulp_bucket_num];
+    // first mismatch
+    TestReq err_req;
+    uint64_t err_data;
+    uint64_t err_ref_data;
+    uint8_t err_excep;
+    uint8_t err_ref_excep;
+};
+
+void printResp(const TestReq &req, const HostFpu &ref, size_t i,
+               const AllResults &xilinx, const AllResults &bluespec) {
+    // convert req to double values
+    double a = 0;
+    if(req.a_valid) {
+        a = unpackDouble(req.a_data);
+    }
+    double b = unpackDouble(req.b);
+    double c = unpackDouble(req.c);
+    logPrint("a = %f, b = %f, c = %f\n", a, b, c);
+
+    // get host results
+    double fma_host = unpackDouble(ref.fma(i));
+    double div_host = unpackDouble(ref.div(i));
+    double sqrt_host = unpackDouble(ref.sqrt(i));
+
+    // get xilinx results
+    double fma_xilinx = unpackDouble(xilinx.fma.data);
+    double div_xilinx = unpackDouble(xilinx.div_bc.data);
+    double sqrt_xilinx = unpackDouble(xilinx.sqrt_c.data);
+
+    // get bluespec results
+    double fma_bluespec = unpackDouble(bluespec.fma.data);
+    double div_bluespec = unpackDouble(bluespec.div_bc.data);
+    double sqrt_bluespec = unpackDouble(bluespec.sqrt_c.data);
+
+    // print results
+    logPrint("fma (a + b * c):\n"
+             "  host     val %f excep %d\n"
+             "  xilinx   val %f excep %d lat %d\n"
+             "  bluespec val %f excep %d lat %d\n",
+             fma_host, ref.fmaExcep(i),
+             fma_xilinx, xilinx.fma.exception, xilinx.fma.latency,
+             fma_bluespec, bluespec.fma.exception, bluespec.fma.latency);
+    logPrint("div (b / c):\n"
+             "  host     val %f excep %d\n"
+             "  xilinx   val %f excep %d lat %d\n"
+             "  bluespec val %f excep %d lat %d\n",
+             div_host, ref.divExcep(i),
+             div_xilinx, xilinx.div_bc.exception, xilinx.div_bc.latency,
+             div_bluespec, bluespec.div_bc.exception, bluespec.div_bc.latency);
+    logPrint("sqrt (c ^ 0.5):\n"
+             "  host     val %f excep %d\n"
+             "  xilinx   val %f excep %d lat %d\n"
+             "  bluespec val %f excep %d lat %d\n",
+             sqrt_host, ref.sqrtExcep(i),
+             sqrt_xilinx, xilinx.sqrt_c.exception, xilinx.sqrt_c.latency,
+             sqrt_bluespec, bluespec.sqrt_c.exception, bluespec.sqrt_c.latency);
+    logPrint("\n");
 }
 
+// check FPU results against x86 in batches, and only keep stats
+class FpuChecker {
+private:
+    HostFpu ref;
+    std::vector<TestReq> reqs;
+    std::vector<AllResults> xilinx_res;
+    std::vector<AllResults> bluespec_res;
+    const bool verbose; // print every result
+    uint64_t check_num;
+    OpStats stats[FpuImplNum][FpuOpNum];
+
+    void checkOp(OpStats &s, uint8_t mask, const TestReq &req,
+                 const Result &res, uint64_t ref_data, uint8_t ref_excep) {
+        int bucket = getUlpBucket(res.data, ref_data);
+        bool excep_ok = (res.exception & mask) == (ref_excep & mask);
+        bool first_err = s.data_err == 0 && s.excep_err == 0;
+        s.ulp_hist[bucket]++;
+        if(bucket != 0) {
+            s.data_err++;
+        }
+        if(!excep_ok) {
+            s.excep_err++;
+        }
+        if(first_err && (bucket != 0 || !excep_ok)) {
+            s.err_req = req;
+            s.err_data = res.data;
+            s.err_ref_data = ref_data;
+            s.err_excep = res.exception;
+            s.err_ref_excep = ref_excep;
+        }
+    }
+
+public:
+    FpuChecker(size_t batch_size, bool v) :
+        ref(batch_size),
+        verbose(v),
+        check_num(0)
+    {
+        reqs.reserve(batch_size);
+        xilinx_res.reserve(batch_size);
+        bluespec_res.reserve(batch_size);
+        memset(stats, 0, sizeof(stats));
+    }
+
+    void add(const TestReq &req, const AllResults &xilinx, const AllResults &bluespec) {
+        ref.add(req.a_valid, req.a_data, req.b, req.c);
+        reqs.push_back(req);
+        xilinx_res.push_back(xilinx);
+        bluespec_res.push_back(bluespec);
+        if(ref.full()) {
+            check();
+        }
+    }
+
+    // check all results in batch
+    void check() {
+        ref.compute();
+        for(size_t i = 0; i < ref.size(); i++) {
+            const AllResults *res[FpuImplNum] = {&xilinx_res[i], &bluespec_res[i]};
+            const uint8_t *mask[FpuImplNum] = {xilinx_excep_mask, bluespec_excep_mask};
+            uint64_t fma_ref[FpuImplNum] = {ref.fma(i), ref.fma(i)};
+#ifdef BSIM
+            fma_ref[XilinxImpl] = unfusedFma(reqs[i]);
+#endif
+            for(int impl = 0; impl < FpuImplNum; impl++) {
+                checkOp(stats[impl][FmaOp], mask[impl][FmaOp], reqs[i],
+                        res[impl]->fma, fma_ref[impl], ref.fmaExcep(i));
+                checkOp(stats[impl][DivOp], mask[impl][DivOp], reqs[i],
+                        res[impl]->div_bc, ref.div(i), ref.divExcep(i));
+                checkOp(stats[impl][SqrtOp], mask[impl][SqrtOp], reqs[i],
+                        res[impl]->sqrt_c, ref.sqrt(i), ref.sqrtExcep(i));
+            }
+            if(verbose) {
+                printResp(reqs[i], ref, i, xilinx_res[i], bluespec_res[i]);
+            }
+        }
+        check_num += ref.size();
+        ref.clear();
+        reqs.clear();
+        xilinx_res.clear();
+        bluespec_res.clear();
+    }
+
+    // print summary of all checks, return true if there is no mismatch
+    bool report() {
+        bool pass = true;
+        for(int impl = 0; impl < FpuImplNum; impl++) {
+            const uint8_t *mask = impl == XilinxImpl ? xilinx_excep_mask : bluespec_excep_mask;
+            for(int op = 0; op < FpuOpNum; op++) {
+                const OpStats &s = stats[impl][op];
+                bool ok = s.data_err == 0 && s.excep_err == 0;
+                fprintf(stderr, "%s: %-8s %-4s: %llu checked, %llu data mismatches, "
+                        "%llu excep mismatches (excep mask %02x)\n",
+                        ok ? "INFO" : "ERROR", fpu_impl_name[impl], fpu_op_name[op],
+                        (long long unsigned)check_num,
+                        (long long unsigned)s.data_err,
+                        (long long unsigned)s.excep_err, mask[op]);
+                if(ok) {
+                    continue;
+                }
+                pass = false;
+                fprintf(stderr, "  ULP diff histogram:");
+                for(int k = 0; k < ulp_bucket_num; k++) {
+                    if(s.ulp_hist[k] == 0) {
+                        continue;
+                    }
+                    if(k == 0) {
+                        fprintf(stderr, " [0] %llu", (long long unsigned)s.ulp_hist[k]);
+                    }
+                    else {
+                        fprintf(stderr, " [2^%d, 2^%d) %llu", k - 1, k,
+                                (long long unsigned)s.ulp_hist[k]);
+                    }
+                }
+                fprintf(stderr, "\n");
+                fprintf(stderr, "  first mismatch: a %d %llx, b %llx, c %llx, "
+                        "data %llx (host %llx), excep %02x (host %02x)\n",
+                        s.err_req.a_valid, (long long unsigned)s.err_req.a_data,
+                        (long long unsigned)s.err_req.b,
+                        (long long unsigned)s.err_req.c,
+                        (long long unsigned)s.err_data,
+                        (long long unsigned)s.err_ref_data,
+                        s.err_excep, s.err_ref_excep);
+            }
+        }
+        return pass;
+    }
+};
+
 class FpuTestIndication : public FpuTestIndicationWrapper {
 private:
-    sem_t sem;
+    sem_t sem; // credits to send reqs
+    FpuChecker &checker;
+    uint32_t expect_tag; // resps are in order, so tags come back in order
+    uint64_t resp_num;
+    sem_t stats_sem; // lane stats received
+    LaneStats div_stats;
+    LaneStats sqrt_stats;
+    sem_t char_sem; // characterization result received
+    CharResp char_resp;
 
 public:
-    FpuTestIndication(int id) : FpuTestIndicationWrapper(id) {
-        sem_init(&sem, 0, 0);
+    FpuTestIndication(int id, int in_flight, FpuChecker &c) :
+        FpuTestIndicationWrapper(id),
+        checker(c),
+        expect_tag(0),
+        resp_num(0)
+    {
+        sem_init(&sem, 0, in_flight);
+        sem_init(&stats_sem, 0, 0);
+        sem_init(&char_sem, 0, 0);
     }
 
     virtual ~FpuTestIndication() {
         sem_destroy(&sem);
+        sem_destroy(&stats_sem);
+        sem_destroy(&char_sem);
     }
 
     virtual void resp (const AllResults xilinx, const AllResults bluespec) {
-        // convert req to double values
-        double a = 0;
-        if(curReq.a_valid) {
-            a = unpackDouble(curReq.a_data);
+        if(uint32_t(xilinx.tag) != expect_tag ||
+           uint32_t(bluespec.tag) != expect_tag) {
+            logPrint("ERROR: resp %llu: expect tag %u, "
+                     "recv xilinx tag %u, bluespec tag %u\n",
+                     (long long unsigned)resp_num, expect_tag,
+                     (unsigned)xilinx.tag, (unsigned)bluespec.tag);
+            logFlush();
+            exit(-1);
         }
-        double b = unpackDouble(curReq.b);
-        double c = unpackDouble(curReq.c);
-        printf("a = %f, b = %f, c = %f\n", a, b, c);
-
-        // compute in host
-        double fma_host = a + b * c;
-        double div_host = b / c;
-        double sqrt_host = sqrt(c);
-
-        // get xilinx results
-        double fma_xilinx = unpackDouble(xilinx.fma.data);
-        double div_xilinx = unpackDouble(xilinx.div_bc.data);
-        double sqrt_xilinx = unpackDouble(xilinx.sqrt_c.data);
-
-        // get bluespec results
-        double fma_bluespec = unpackDouble(bluespec.fma.data);
-        double div_bluespec = unpackDouble(bluespec.div_bc.data);
-        double sqrt_bluespec = unpackDouble(bluespec.sqrt_c.data);
-
-        // print results
-        printf("fma (a + b * c):\n"
-               "  host     val %f\n"
-               "  xilinx   val %f excep %d lat %d\n"
-               "  bluespec val %f excep %d lat %d\n",
-               fma_host,
-               fma_xilinx, xilinx.fma.exception, xilinx.fma.latency,
-               fma_bluespec, bluespec.fma.exception, bluespec.fma.latency);
-        printf("div (b / c):\n"
-               "  host     val %f\n"
-               "  xilinx   val %f excep %d lat %d\n"
-               "  bluespec val %f excep %d lat %d\n",
-               div_host,
-               div_xilinx, xilinx.div_bc.exception, xilinx.div_bc.latency,
-               div_bluespec, bluespec.div_bc.exception, bluespec.div_bc.latency);
-        printf("sqrt (c ^ 0.5):\n"
-               "  host     val %f\n"
-               "  xilinx   val %f excep %d lat %d\n"
-               "  bluespec val %f excep %d lat %d\n",
-               sqrt_host,
-               sqrt_xilinx, xilinx.sqrt_c.exception, xilinx.sqrt_c.latency,
-               sqrt_bluespec, bluespec.sqrt_c.exception, bluespec.sqrt_c.latency);
-
+        checker.add(all_req[expect_tag], xilinx, bluespec);
+        expect_tag = (expect_tag + 1) & (tag_num - 1);
+        resp_num++;
         sem_post(&sem);
     }
 
+    virtual void laneStats(const LaneStats div, const LaneStats sqrt) {
+        div_stats = div;
+        sqrt_stats = sqrt;
+        sem_post(&stats_sem);
+    }
+
+    virtual void charResp(const CharResp r) {
+        char_resp = r;
+        sem_post(&char_sem);
+    }
+
     void wait() {
         sem_wait(&sem);
     }
+
+    // wait for the result of a characterization test
+    CharResp waitChar() {
+        sem_wait(&char_sem);
+        return char_resp;
+    }
+
+    // wait for the lane stats requested by getLaneStats
+    void waitLaneStats(LaneStats &div, LaneStats &sqrt) {
+        sem_wait(&stats_sem);
+        div = div_stats;
+        sqrt = sqrt_stats;
+    }
+
+    // give back credits taken when waiting for all reqs in flight
+    void release(int credits) {
+        for(int i = 0; i < credits; i++) {
+            sem_post(&sem);
+        }
+    }
 };
 
+// characterization mode: default number of reqs to each unit
+#ifdef BSIM
+const uint32_t default_char_req_num = 1 << 10;
+#else
+const uint32_t default_char_req_num = 1 << 20;
+#endif
+// characterization mode: cycles between two reqs sent to a unit
+const uint16_t char_intervals[] = {1, 2, 4, 8, 16};
+const int char_interval_num = sizeof(char_intervals) / sizeof(char_intervals[0]);
+
 void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s TEST_NUM\n", prog);
+    fprintf(stderr, "Usage: %s TEST_NUM [IN_FLIGHT]\n", prog);
+    fprintf(stderr, "       %s char [REQ_NUM]\n", prog);
+    fprintf(stderr, "IN_FLIGHT = 1 (default) prints every result; "
+            "IN_FLIGHT in [2, %u] streams reqs and reports throughput\n",
+            tag_num);
+    fprintf(stderr, "char sends REQ_NUM (default %u) reqs to each unit of "
+            "each FPU at several injection intervals, and reports initiation "
+            "interval, latency and throughput\n", default_char_req_num);
+}
+
+double getTime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return double(t.tv_sec) + double(t.tv_nsec) * 1e-9;
+}
+
+// occupancy of xilinx div/sqrt lanes between two snapshots of the counters
+void reportLaneStats(Bench &bench, const char *name,
+                     const LaneStats &begin, const LaneStats &end) {
+    double cycles = double(end.cycles - begin.cycles);
+    double reqs = double(end.reqs - begin.reqs);
+    double occupancy = double(end.inflightSum - begin.inflightSum) / cycles;
+    double full = double(end.fullCycles - begin.fullCycles) / cycles;
+    fprintf(stderr, "INFO: xilinx %s %d lanes: %.0f reqs, %.4f reqs/cycle, "
+            "%.2f reqs in flight, all lanes full %.2f%% cycles\n",
+            name, FP_DIV_SQRT_LANES, reqs, reqs / cycles, occupancy, full * 100);
+    std::string prefix(name);
+    bench.record(prefix + "_throughput", reqs / cycles, "reqs/cycle", true);
+    bench.record(prefix + "_occupancy", occupancy, "reqs", true);
+    bench.record(prefix + "_full", full, "ratio", false);
+}
+
+int runChar(FpuTestRequestProxy &testReq, FpuTestIndication &testInd,
+            uint32_t req_num) {
+    // same order as FpuImpl and FpuOp
+    const CharImpl impls[FpuImplNum] = {CharXilinx, CharBluespec};
+    const CharOp ops[FpuOpNum] = {CharFma, CharDiv, CharSqrt};
+
+    Bench bench("FpuTest_char");
+    std::mt19937_64 gen;
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        fprintf(stderr, "%-8s %-4s %8s %8s %8s %8s %8s %8s %10s\n",
+                "fpu", "op", "interval", "req II", "resp II",
+                "lat min", "lat avg", "lat max", "reqs/cycle");
+        for(int op = 0; op < FpuOpNum; op++) {
+            // best of each implementation: max throughput, and min latency
+            // when it is not loaded
+            double max_tput[FpuImplNum] = {0, 0};
+            uint32_t min_lat[FpuImplNum] = {0, 0};
+            for(int impl = 0; impl < FpuImplNum; impl++) {
+                for(int i = 0; i < char_interval_num; i++) {
+                    CharReq req;
+                    req.impl = impls[impl];
+                    req.op = ops[op];
+                    req.interval = char_intervals[i];
+                    req.num = req_num;
+                    req.seed = gen() | 1; // xorshift seed cannot be 0
+                    testReq.charTest(req);
+                    CharResp r = testInd.waitChar();
+
+                    double req_ii = double(r.issueSpan) / double(r.num - 1);
+                    double resp_ii = double(r.respSpan) / double(r.num - 1);
+                    double avg_lat = double(r.totalLatency) / double(r.num);
+                    double tput = double(r.num) / double(r.cycles);
+                    fprintf(stderr, "%-8s %-4s %8u %8.2f %8.2f %8u %8.2f %8u %10.4f\n",
+                            fpu_impl_name[impl], fpu_op_name[op],
+                            unsigned(r.interval), req_ii, resp_ii,
+                            unsigned(r.minLatency), avg_lat,
+                            unsigned(r.maxLatency), tput);
+
+                    char prefix[64];
+                    snprintf(prefix, sizeof(prefix), "%s_%s_i%u_",
+                             fpu_impl_name[impl], fpu_op_name[op],
+                             unsigned(r.interval));
+                    std::string p(prefix);
+                    bench.record(p + "req_ii", req_ii, "cycles", false);
+                    bench.record(p + "lat_avg", avg_lat, "cycles", false);
+                    bench.record(p + "throughput", tput, "reqs/cycle", true);
+
+                    if(tput > max_tput[impl]) {
+                        max_tput[impl] = tput;
+                    }
+                    if(i == 0 || r.minLatency < min_lat[impl]) {
+                        min_lat[impl] = r.minLatency;
+                    }
+                }
+            }
+            fprintf(stderr, "INFO: %s: saturation throughput xilinx %.4f, "
+                    "bluespec %.4f reqs/cycle; min latency xilinx %u, "
+                    "bluespec %u cycles\n", fpu_op_name[op],
+                    max_tput[0], max_tput[1], min_lat[0], min_lat[1]);
+        }
+    }
+    return bench.finish();
 }
 
 int main(int argc, char **argv) {
-    if(argc != 2) {
+    if(argc != 2 && argc != 3) {
         usage(argv[0]);
         return 0;
     }
 
+    if(strcmp(argv[1], "char") == 0) {
+        uint32_t req_num = default_char_req_num;
+        if(argc == 3) {
+            req_num = strtoul(argv[2], NULL, 0);
+            if(req_num < 2) {
+                usage(argv[0]);
+                return 0;
+            }
+        }
+        FpuChecker checker(1, false); // unused
+        FpuTestIndication testInd(IfcNames_FpuTestIndicationH2S, 1, checker);
+        FpuTestRequestProxy testReq(IfcNames_FpuTestRequestS2H);
+        return runChar(testReq, testInd, req_num);
+    }
+
     int test_num = atoi(argv[1]);
     if(test_num <= 0) {
         usage(argv[0]);
         return 0;
     }
 
-    FpuTestIndication testInd(IfcNames_FpuTestIndicationH2S);
+    int in_flight = 1;
+    if(argc == 3) {
+        in_flight = atoi(argv[2]);
+        if(in_flight <= 0 || uint32_t(in_flight) > tag_num) {
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    bool verbose = in_flight == 1;
+
+    // check every result immediately when verbose, otherwise in batches
+    FpuChecker checker(verbose ? 1 : 4096, verbose);
+    FpuTestIndication testInd(IfcNames_FpuTestIndicationH2S, in_flight, checker);
     FpuTestRequestProxy testReq(IfcNames_FpuTestRequestS2H);
 
-    // start test
+    // every run sends test_num new tests, results of all runs are checked
+    Bench bench(verbose ? "FpuTest" : "FpuTest_stream");
     std::normal_distribution<double> norm;
     std::default_random_engine gen;
-    for(int i = 0; i < test_num; i++) {
-        // randomize input data
-        double a = norm(gen);
-        double b = norm(gen);
-        double c = norm(gen);
-        
-        // create test req
-        curReq.a_valid = 1;
-        curReq.a_data = packDouble(a);
-        curReq.b = packDouble(b);
-        curReq.c = packDouble(c);
-        printf("Test %d: a %d %llx (%f), b %llx (%f), c %llx (%f)\n",
-               i, curReq.a_valid, (long long unsigned)curReq.a_data, a,
-               (long long unsigned)curReq.b, b,
-               (long long unsigned)curReq.c, c);
-
-        // send to FPGA and wait
-        testReq.req(curReq);
-        testInd.wait();
-
-        printf("\n");
-
-        // redo the test with invalid a
-        curReq.a_valid = 0;
-        printf("Test %d alt: a %d %llx (%f), b %llx (%f), c %llx (%f)\n",
-               i, curReq.a_valid, (long long unsigned)curReq.a_data, a,
-               (long long unsigned)curReq.b, b,
-               (long long unsigned)curReq.c, c);
-        testReq.req(curReq);
-        testInd.wait();
-
-        printf("\n");
-    }
-
-    return 0;
+    uint32_t tag = 0;
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        LaneStats div_begin, sqrt_begin;
+        testReq.getLaneStats();
+        testInd.waitLaneStats(div_begin, sqrt_begin);
+        double start_time = getTime();
+        for(int i = 0; i < test_num; i++) {
+            // randomize input data
+            double a = norm(gen);
+            double b = norm(gen);
+            double c = norm(gen);
+
+            // do the test with valid a, and redo with invalid a
+            for(int alt = 0; alt < 2; alt++) {
+                // wait for a free tag
+                testInd.wait();
+
+                // create test req
+                TestReq &req = all_req[tag];
+                req.tag = tag;
+                req.a_valid = alt == 0;
+                req.a_data = packDouble(a);
+                req.b = packDouble(b);
+                req.c = packDouble(c);
+                if(verbose) {
+                    logPrint("Test %d%s: a %d %llx (%f), b %llx (%f), c %llx (%f)\n",
+                             i, alt ? " alt" : "",
+                             req.a_valid, (long long unsigned)req.a_data, a,
+                             (long long unsigned)req.b, b,
+                             (long long unsigned)req.c, c);
+                }
+
+                // send to FPGA
+                testReq.req(req);
+                tag = (tag + 1) & (tag_num - 1);
+            }
+        }
+        // wait for all reqs in flight
+        for(int i = 0; i < in_flight; i++) {
+            testInd.wait();
+        }
+        double elap_time = getTime() - start_time;
+        testInd.release(in_flight);
+        logFlush();
+
+        // each req does fma, div and sqrt in both xilinx and bluespec FPUs
+        uint64_t req_num = 2 * uint64_t(test_num);
+        fprintf(stderr, "INFO: %llu reqs, %d in flight, %f s, "
+                "%f reqs/s, %f FPU ops/s\n",
+                (long long unsigned)req_num, in_flight, elap_time,
+                double(req_num) / elap_time,
+                double(req_num * 3 * 2) / elap_time);
+        bench.record("req_rate", double(req_num) / elap_time, "reqs/s", true);
+        bench.record("fpu_op_rate", double(req_num * 3 * 2) / elap_time, "ops/s", true);
+
+        LaneStats div_end, sqrt_end;
+        testReq.getLaneStats();
+        testInd.waitLaneStats(div_end, sqrt_end);
+        reportLaneStats(bench, "div", div_begin, div_end);
+        reportLaneStats(bench, "sqrt", sqrt_begin, sqrt_end);
+    }
+
+    // check remaining results, and print summary
+    checker.check();
+    logFlush();
+    if(!checker.report()) {
+        return -1;
+    }
+    return bench.finish();
 }
@@ -1,10 +1,19 @@
 #include "MulDivTestIndication.h"
 #include "MulDivTestRequest.h"
+#include "Bench.h"
+#include "SpscQueue.h"
+#include "AsyncLog.h"
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
 #include <random>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 const uint64_t most_negative = 0x8000000000000000ULL;
 
@@ -65,131 +74,310 @@ bool sameResp(const MulDivResp &x, const MulDivResp &y) {
             x.divTag == y.divTag);
 }
 
-void printReq(const MulDivReq &r, FILE *fp = stderr) {
-    fprintf(fp, "a %016llx, b %016llx, mul sign %d, div sign %d tag %3d\n",
-            (long long unsigned)(r.a), (long long unsigned)(r.b),
-            int(r.mulSign), int(r.divSigned), int(r.tag));
+// print (to async log) a line starting with prefix
+void printReq(const char *prefix, const MulDivReq &r) {
+    logPrint("%sa %016llx, b %016llx, mul sign %d, div sign %d tag %3d\n", prefix,
+             (long long unsigned)(r.a), (long long unsigned)(r.b),
+             int(r.mulSign), int(r.divSigned), int(r.tag));
 }
 
-void printResp(const MulDivResp &r, FILE *fp = stderr) {
-    fprintf(fp, "product %016llx %016llx, tag %3d, "
-            "quotient %016llx, remainder %016llx, tag %3d\n",
-            (long long unsigned)(r.productHi),
-            (long long unsigned)(r.productLo),
-            int(r.mulTag),
-            (long long unsigned)(r.quotient),
-            (long long unsigned)(r.remainder),
-            int(r.divTag));
+void printResp(const char *prefix, const MulDivResp &r) {
+    logPrint("%sproduct %016llx %016llx, tag %3d, "
+             "quotient %016llx, remainder %016llx, tag %3d\n", prefix,
+             (long long unsigned)(r.productHi),
+             (long long unsigned)(r.productLo),
+             int(r.mulTag),
+             (long long unsigned)(r.quotient),
+             (long long unsigned)(r.remainder),
+             int(r.divTag));
 }
 
-const int test_num = MAX_TEST_NUM;
-MulDivReq all_req[test_num];
-
-class MulDivTestIndication : public MulDivTestIndicationWrapper {
-private:
-    sem_t sem;
-    int resp_id;
-
-public:
-    MulDivTestIndication(int id) : MulDivTestIndicationWrapper(id), resp_id(0) {
-        sem_init(&sem, 0, 0);
-    }
-
-    virtual ~MulDivTestIndication() {
-        sem_destroy(&sem);
-    }
-
-    virtual void resp(MulDivResp r) {
-        MulDivResp ref = refResp(all_req[resp_id]);
-
-        fprintf(stderr, "Test %d\n", resp_id);
-        fprintf(stderr, "Req : ");
-        printReq(all_req[resp_id]);
-        fprintf(stderr, "Resp: ");
-        printResp(r);
-        fprintf(stderr, "Ref : ");
-        printResp(ref);
-        fprintf(stderr, "\n");
-
-        if(!sameResp(r, ref)) {
-            fprintf(stderr, "FAIL!!\n");
-            exit(-1);
-        }
-
-        resp_id++;
-        if(resp_id == test_num) {
-            sem_post(&sem);
-        }
-    }
-
-    void wait() {
-        sem_wait(&sem);
-    }
-};
-
-int main(int argc, char **argv) {
-    MulDivTestIndication indication(IfcNames_MulDivTestIndicationH2S);
-    MulDivTestRequestProxy reqProxy(IfcNames_MulDivTestRequestS2H);
-
-    // first some corner case tests
+// corner case tests
+void getCornerReqs(std::vector<MulDivReq> &reqs) {
     MulDivReq req;
     // overflow
     req.a = most_negative;
     req.b = uint64_t(-1LL);
     req.mulSign = Signed;
     req.divSigned = true;
-    all_req[0] = req;
+    reqs.push_back(req);
     // div by 0
     req.a = most_negative;
     req.b = 0;
     req.mulSign = Unsigned;
     req.divSigned = false;
-    all_req[1] = req;
+    reqs.push_back(req);
     // div by 0
     req.a = -200;
     req.b = 0;
     req.mulSign = SignedUnsigned;
     req.divSigned = true;
-    all_req[2] = req;
+    reqs.push_back(req);
     // div by 0
     req.a = 0;
     req.b = 0;
     req.mulSign = Signed;
     req.divSigned = false;
-    all_req[3] = req;
+    reqs.push_back(req);
     // div by 0
     req.a = 9;
     req.b = 0;
     req.mulSign = Unsigned;
     req.divSigned = true;
-    all_req[4] = req;
+    reqs.push_back(req);
     // basic siged div
     req.a = 7;
     req.b = 3;
     req.mulSign = SignedUnsigned;
     req.divSigned = true;
-    all_req[5] = req;
+    reqs.push_back(req);
     // basic siged div
     req.a = -7;
     req.b = 3;
     req.mulSign = SignedUnsigned;
     req.divSigned = true;
-    all_req[6] = req;
+    reqs.push_back(req);
     // basic siged div
     req.a = 7;
     req.b = -3;
     req.mulSign = SignedUnsigned;
     req.divSigned = true;
-    all_req[7] = req;
+    reqs.push_back(req);
     // basic siged div
     req.a = -7;
     req.b = -3;
     req.mulSign = SignedUnsigned;
     req.divSigned = true;
-    all_req[8] = req;
+    reqs.push_back(req);
+}
+
+// batch mode: all tests are buffered in FPGA before starting
+const int test_num = MAX_TEST_NUM;
+MulDivReq all_req[test_num];
+
+// streaming mode: tests in flight, indexed by tag
+const uint32_t tag_num = 1 << USER_TAG_SIZE;
+MulDivReq inflight_req[tag_num];
+
+// perf mode: default number of ops per unit
+#ifdef BSIM
+const uint32_t default_perf_op_num = 1 << 12;
+#else
+const uint32_t default_perf_op_num = 1 << 24;
+#endif
+
+// pool of threads checking resps against x86
+class MulDivChecker {
+private:
+    struct CheckItem {
+        MulDivReq req;
+        MulDivResp resp;
+    };
+    typedef SpscQueue<CheckItem, 12> CheckQueue;
+
+    // only print the first few failures
+    static const uint64_t max_fail_print = 16;
+
+    std::vector<CheckQueue*> queues; // one queue per thread
+    std::vector<std::thread> threads;
+    uint32_t next_queue; // used by producer to distribute work
+    std::atomic<bool> stop;
+    std::atomic<uint64_t> fail_num;
+    std::mutex print_mutex;
+
+    void checkOne(const CheckItem &item) {
+        MulDivResp ref = refResp(item.req);
+        if(sameResp(item.resp, ref)) {
+            return;
+        }
+        uint64_t n = fail_num.fetch_add(1, std::memory_order_relaxed);
+        if(n < max_fail_print) {
+            // keep lines of a failure together
+            std::lock_guard<std::mutex> lock(print_mutex);
+            logPrint("FAIL!!\n");
+            printReq("Req : ", item.req);
+            printResp("Resp: ", item.resp);
+            printResp("Ref : ", ref);
+            logPrint("\n");
+        }
+    }
+
+    void run(CheckQueue *q) {
+        CheckItem item;
+        while(true) {
+            if(q->deq(item)) {
+                checkOne(item);
+            }
+            else if(stop.load(std::memory_order_acquire)) {
+                // producer is done, drain the queue
+                while(q->deq(item)) {
+                    checkOne(item);
+                }
+                break;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+public:
+    MulDivChecker(int thread_num) : next_queue(0), stop(false), fail_num(0) {
+        for(int i = 0; i < thread_num; i++) {
+            queues.push_back(new CheckQueue);
+        }
+        for(int i = 0; i < thread_num; i++) {
+            threads.push_back(std::thread(&MulDivChecker::run, this, queues[i]));
+        }
+    }
+
+    ~MulDivChecker() {
+        finish();
+        for(uint32_t i = 0; i < queues.size(); i++) {
+            delete queues[i];
+        }
+    }
+
+    // called by a single producer thread
+    void check(const MulDivReq &req, const MulDivResp &resp) {
+        CheckItem item;
+        item.req = req;
+        item.resp = resp;
+        // round robin among queues, skip the full ones
+        while(!queues[next_queue]->enq(item)) {
+            next_queue = (next_queue + 1) % queues.size();
+            if(next_queue == 0) {
+                std::this_thread::yield();
+            }
+        }
+        next_queue = (next_queue + 1) % queues.size();
+    }
+
+    // wait for all checks to finish
+    void finish() {
+        stop.store(true, std::memory_order_release);
+        for(uint32_t i = 0; i < threads.size(); i++) {
+            if(threads[i].joinable()) {
+                threads[i].join();
+            }
+        }
+    }
+
+    uint64_t getFailNum() {
+        return fail_num.load();
+    }
+};
+
+class MulDivTestIndication : public MulDivTestIndicationWrapper {
+private:
+    // batch/perf mode: done; streaming mode: credits to send tests
+    sem_t sem;
+    MulDivChecker *checker; // NULL in batch/perf mode
+    int resp_id;
+    uint32_t expect_tag;
+    MulDivPerfResp perf_resp;
+
+public:
+    MulDivTestIndication(int id, MulDivChecker *c) :
+        MulDivTestIndicationWrapper(id),
+        checker(c),
+        resp_id(0),
+        expect_tag(0)
+    {
+        sem_init(&sem, 0, checker ? tag_num : 0);
+    }
+
+    virtual ~MulDivTestIndication() {
+        sem_destroy(&sem);
+    }
+
+    virtual void resp(MulDivResp r) {
+        if(checker) {
+            // mul and div units are in order, so tags come back in order
+            if(uint32_t(r.mulTag) != expect_tag || uint32_t(r.divTag) != expect_tag) {
+                logPrint("FAIL!! expect tag %u, recv mul tag %u, div tag %u\n",
+                         expect_tag, unsigned(r.mulTag), unsigned(r.divTag));
+                logFlush();
+                exit(-1);
+            }
+            checker->check(inflight_req[expect_tag], r);
+            expect_tag = (expect_tag + 1) & (tag_num - 1);
+            sem_post(&sem);
+            return;
+        }
+
+        MulDivResp ref = refResp(all_req[resp_id]);
+
+        logPrint("Test %d\n", resp_id);
+        printReq("Req : ", all_req[resp_id]);
+        printResp("Resp: ", r);
+        printResp("Ref : ", ref);
+        logPrint("\n");
+
+        if(!sameResp(r, ref)) {
+            logPrint("FAIL!!\n");
+            logFlush();
+            exit(-1);
+        }
+
+        resp_id++;
+        if(resp_id == test_num) {
+            sem_post(&sem);
+        }
+    }
+
+    virtual void perfResp(MulDivPerfResp r) {
+        perf_resp = r;
+        sem_post(&sem);
+    }
+
+    void wait() {
+        sem_wait(&sem);
+    }
+
+    // perf mode: wait for the result of a perf test
+    MulDivPerfResp waitPerf() {
+        sem_wait(&sem);
+        logFlush();
+        return perf_resp;
+    }
+
+    // give back credits taken when waiting for all tests in flight
+    void release(int credits) {
+        for(int i = 0; i < credits; i++) {
+            sem_post(&sem);
+        }
+    }
+};
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [STREAM_TEST_NUM [CHECK_THREADS]]\n", prog);
+    fprintf(stderr, "       %s perf [OP_NUM]\n", prog);
+    fprintf(stderr, "No args runs %d tests in batch mode and prints every test; "
+            "STREAM_TEST_NUM > 0 streams that many tests, and 0 streams forever\n",
+            test_num);
+    fprintf(stderr, "perf drives each unit alone with OP_NUM back-to-back ops "
+            "(default %u), and reports latency and ops/cycle\n",
+            default_perf_op_num);
+}
+
+double getTime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return double(t.tv_sec) + double(t.tv_nsec) * 1e-9;
+}
+
+void runBatch(MulDivTestRequestProxy &reqProxy, MulDivTestIndication &indication) {
+    // first some corner case tests
+    std::vector<MulDivReq> corner_req;
+    getCornerReqs(corner_req);
+    for(uint32_t i = 0; i < corner_req.size(); i++) {
+        all_req[i] = corner_req[i];
+    }
 
     // remaining random reqs
-    for(int i = 9; i < test_num; i++) {
+    MulDivReq req;
+    for(int i = corner_req.size(); i < test_num; i++) {
         req.a = rand64();
         req.b = rand64();
         req.mulSign = MulSign(rand() % 3);
@@ -210,7 +398,187 @@ int main(int argc, char **argv) {
 
     // wait done
     indication.wait();
+    logFlush();
     fprintf(stderr, "PASS!!\n");
+}
+
+// returns tests per second, tag is the next tag to use (kept across runs)
+double runStream(MulDivTestRequestProxy &reqProxy, MulDivTestIndication &indication,
+                 MulDivChecker &checker, uint64_t stream_num, uint32_t &tag) {
+    // tests are generated in chunks, starting with corner cases
+    const uint32_t chunk_size = 4096;
+    std::vector<MulDivReq> chunk;
+    chunk.reserve(chunk_size);
+    getCornerReqs(chunk);
+
+    // print progress periodically
+    const uint64_t progress_mask = (1ULL << 24) - 1;
+
+    std::mt19937_64 gen;
+    uint64_t sent = 0;
+    double start_time = getTime();
+    while(stream_num == 0 || sent < stream_num) {
+        // generate random reqs
+        MulDivReq req;
+        while(chunk.size() < chunk_size) {
+            req.a = gen();
+            req.b = gen();
+            req.mulSign = MulSign(gen() % 3);
+            req.divSigned = bool(gen() & 1);
+            chunk.push_back(req);
+        }
+
+        // send to FPGA
+        for(uint32_t i = 0; i < chunk.size(); i++) {
+            if(stream_num != 0 && sent == stream_num) {
+                break;
+            }
+            // wait for a free tag
+            indication.wait();
+            MulDivReq &r = inflight_req[tag];
+            r = chunk[i];
+            r.tag = UserTag(tag);
+            reqProxy.streamTest(r);
+            tag = (tag + 1) & (tag_num - 1);
+            sent++;
+
+            if((sent & progress_mask) == 0) {
+                double elap_time = getTime() - start_time;
+                fprintf(stderr, "INFO: %llu tests sent, %llu failures, %f tests/s\n",
+                        (long long unsigned)sent,
+                        (long long unsigned)checker.getFailNum(),
+                        double(sent) / elap_time);
+            }
+        }
+        chunk.clear();
+    }
+
+    // wait for all tests in flight
+    for(uint32_t i = 0; i < tag_num; i++) {
+        indication.wait();
+    }
+    double elap_time = getTime() - start_time;
+    indication.release(tag_num);
+
+    fprintf(stderr, "INFO: %llu tests, %f s, %f tests/s\n",
+            (long long unsigned)sent, elap_time, double(sent) / elap_time);
+    return double(sent) / elap_time;
+}
+
+// perf mode: each unit and sign mode is measured separately
+struct PerfConfig {
+    const char *name;
+    MulDivPerfUnit unit;
+    MulSign mulSign;
+    bool divSigned;
+};
+
+const PerfConfig perf_configs[] = {
+    {"mul_signed", PerfMul, Signed, false},
+    {"mul_unsigned", PerfMul, Unsigned, false},
+    {"mul_signed_unsigned", PerfMul, SignedUnsigned, false},
+    {"div_signed", PerfDiv, Signed, true},
+    {"div_unsigned", PerfDiv, Signed, false}
+};
+
+int runPerf(MulDivTestRequestProxy &reqProxy, MulDivTestIndication &indication,
+            uint32_t op_num) {
+    const int config_num = sizeof(perf_configs) / sizeof(perf_configs[0]);
+    fprintf(stderr, "INFO: perf mode, %u ops per unit, %u tags\n",
+            op_num, tag_num);
+
+    Bench bench("MulDivTest_perf");
+    std::mt19937_64 gen;
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        fprintf(stderr, "%-20s %10s %8s %8s %8s %10s\n",
+                "unit", "cycles", "lat min", "lat avg", "lat max", "ops/cycle");
+        for(int i = 0; i < config_num; i++) {
+            const PerfConfig &cfg = perf_configs[i];
+            MulDivPerfReq req;
+            req.unit = cfg.unit;
+            req.mulSign = cfg.mulSign;
+            req.divSigned = cfg.divSigned;
+            req.num = op_num;
+            req.seed = gen() | 1; // xorshift seed cannot be 0
+            reqProxy.perfTest(req);
+            MulDivPerfResp r = indication.waitPerf();
 
-    return 0;
+            double avg_lat = double(r.totalLatency) / double(r.num);
+            double ops_per_cycle = double(r.num) / double(r.cycles);
+            fprintf(stderr, "%-20s %10u %8u %8.2f %8u %10.4f\n",
+                    cfg.name, unsigned(r.cycles), unsigned(r.minLatency),
+                    avg_lat, unsigned(r.maxLatency), ops_per_cycle);
+
+            std::string prefix(cfg.name);
+            bench.record(prefix + "_lat_min", r.minLatency, "cycles", false);
+            bench.record(prefix + "_lat_avg", avg_lat, "cycles", false);
+            bench.record(prefix + "_lat_max", r.maxLatency, "cycles", false);
+            bench.record(prefix + "_throughput", ops_per_cycle, "ops/cycle", true);
+        }
+    }
+    return bench.finish();
+}
+
+int main(int argc, char **argv) {
+    if(argc > 3) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "perf") == 0) {
+        uint32_t op_num = default_perf_op_num;
+        if(argc == 3) {
+            op_num = strtoul(argv[2], NULL, 0);
+            if(op_num == 0) {
+                usage(argv[0]);
+                return 0;
+            }
+        }
+        MulDivTestIndication indication(IfcNames_MulDivTestIndicationH2S, NULL);
+        MulDivTestRequestProxy reqProxy(IfcNames_MulDivTestRequestS2H);
+        return runPerf(reqProxy, indication, op_num);
+    }
+
+    if(argc == 1) {
+        MulDivTestIndication indication(IfcNames_MulDivTestIndicationH2S, NULL);
+        MulDivTestRequestProxy reqProxy(IfcNames_MulDivTestRequestS2H);
+        runBatch(reqProxy, indication);
+        return 0;
+    }
+
+    uint64_t stream_num = strtoull(argv[1], NULL, 0);
+    int thread_num = std::thread::hardware_concurrency();
+    thread_num = thread_num > 2 ? thread_num - 2 : 1;
+    if(argc == 3) {
+        thread_num = atoi(argv[2]);
+        if(thread_num <= 0) {
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    MulDivChecker checker(thread_num);
+    MulDivTestIndication indication(IfcNames_MulDivTestIndicationH2S, &checker);
+    MulDivTestRequestProxy reqProxy(IfcNames_MulDivTestRequestS2H);
+    fprintf(stderr, "INFO: stream %llu tests (0 means forever), "
+            "%u in flight, %d check threads\n",
+            (long long unsigned)stream_num, tag_num, thread_num);
+    Bench bench("MulDivTest_stream");
+    uint32_t tag = 0;
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        double rate = runStream(reqProxy, indication, checker, stream_num, tag);
+        bench.record("test_rate", rate, "tests/s", true);
+    }
+    checker.finish();
+    logFlush();
+
+    uint64_t fail_num = checker.getFailNum();
+    fprintf(stderr, "INFO: %llu failures\n", (long long unsigned)fail_num);
+    fprintf(stderr, fail_num == 0 ? "PASS!!\n" : "FAIL!!\n");
+    if(fail_num > 0) {
+        return -1;
+    }
+    return bench.finish();
 }
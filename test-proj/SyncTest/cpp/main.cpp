@@ -24,28 +24,104 @@
 #include "SyncTestIndication.h"
 #include "SyncTestRequest.h"
 #include "GeneratedTypes.h"
+#include "Bench.h"
+#include "AsyncLog.h"
 #include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <map>
 
 class SyncTestIndication;
 SyncTestIndication *testInd = 0;
 SyncTestRequestProxy *testReq = 0;
 
+// sync FIFO backends, same order as SyncFifoBackend in SyncFifo.bsv
+const char *backend_name[] = {
+    "bsv",
+    "bsv_bram",
+    "connectal_bram",
+    "xilinx_lut",
+    "xilinx_bram"
+};
+const int backend_num = sizeof(backend_name) / sizeof(backend_name[0]);
+
 class SyncTestIndication : public SyncTestIndicationWrapper {
 private:
     sem_t sem;
     long long unsigned test_num;
     TestMode mode;
     int fifo_num; // number of fifos to finish test
+    Bench *bench;
+    // throughput or latency of each test, indexed by data width, then log2
+    // FIFO size, then backend (< 0 means not tested)
+    std::map<int, std::vector<std::vector<double> > > results;
+    // Stream mode results, one line per crossing
+    std::vector<std::string> stream_lines;
+
+    const char *getBackendName(int backend) {
+        return backend < backend_num ? backend_name[backend] : "unknown";
+    }
+
+    // one table per data width: FIFO size x backend
+    void printMatrix() {
+        const char *unit = mode == Throughput ? "throughput (data/cycle)" : "latency (cycles)";
+        for(std::map<int, std::vector<std::vector<double> > >::iterator it = results.begin();
+            it != results.end(); it++) {
+            logPrint("INFO: %d-bit data, %s\n", it->first, unit);
+            logPrint("%10s", "FIFO size");
+            for(int b = 0; b < backend_num; b++) {
+                logPrint(" %15s", backend_name[b]);
+            }
+            logPrint("\n");
+            for(int log_sz = 0; log_sz <= LOG_MAX_FIFO_SZ; log_sz++) {
+                const std::vector<double> &row = it->second[log_sz];
+                logPrint("%10d", 1 << log_sz);
+                for(int b = 0; b < backend_num; b++) {
+                    if(row[b] < 0) {
+                        logPrint(" %15s", "-");
+                    }
+                    else {
+                        logPrint(" %15.4f", row[b]);
+                    }
+                }
+                logPrint("\n");
+            }
+        }
+    }
+
+    // Stream mode: fast clk -> current clk throughput of a crossing
+    void streamDone(uint8_t backend, uint8_t batch, uint8_t logFifoSz,
+                    uint64_t totalTime, uint64_t beatNum) {
+        std::string name = batch == 0 ? std::string(getBackendName(backend)) :
+                           "gearbox" + std::to_string(batch) + "_" + getBackendName(backend);
+        double throughput = double(test_num) / double(totalTime);
+        double occupancy = beatNum > 0 ? double(test_num) / double(beatNum) : 0;
+        char line[256];
+        snprintf(line, sizeof(line), "%24s %10d %16.4f %14.2f",
+                 name.c_str(), 1 << logFifoSz, throughput, occupancy);
+        stream_lines.push_back(line);
+        bench->record("stream_" + name + "_throughput", throughput, "data/cycle", true);
+        fifo_num--;
+        if(fifo_num == 0) {
+            logPrint("INFO: fast clk -> slow clk streaming, throughput in slow cycles\n");
+            logPrint("%24s %10s %16s %14s\n",
+                     "crossing", "FIFO size", "data/cycle", "data/beat");
+            for(size_t i = 0; i < stream_lines.size(); i++) {
+                logPrint("%s\n", stream_lines[i].c_str());
+            }
+            sem_post(&sem);
+        }
+    }
 
 public:
-    SyncTestIndication(int id, long long unsigned n_test, TestMode m) :
+    SyncTestIndication(int id, long long unsigned n_test, TestMode m, Bench *b) :
         SyncTestIndicationWrapper(id), 
         test_num(n_test),
         mode(m),
-        fifo_num(LOG_MAX_FIFO_SZ + 1) // macro defined in makefile
+        fifo_num(0),
+        bench(b)
     {
         sem_init(&sem, 0, 0);
     }
@@ -54,38 +130,69 @@ public:
         sem_destroy(&sem);
     }
 
-    virtual void done(uint8_t logFifoSz, uint64_t totalTime) {
-        fprintf(stderr, "INFO: FIFO size %d done: total %llu cycles, ",
-                1 << logFifoSz, (long long unsigned)totalTime);
+    virtual void started(uint16_t testNum) {
+        logPrint("INFO: %d tests started\n", (int)testNum);
+        fifo_num = testNum;
+        results.clear();
+        stream_lines.clear();
+    }
+
+    virtual void done(uint8_t backend, uint8_t batch, uint8_t logFifoSz, uint16_t dataSz,
+                      uint64_t totalTime, uint64_t beatNum) {
+        if(mode == Stream) {
+            streamDone(backend, batch, logFifoSz, totalTime, beatNum);
+            return;
+        }
+        logPrint("INFO: %s FIFO size %d data %d bits done: total %llu cycles, ",
+                 getBackendName(backend), 1 << logFifoSz, (int)dataSz,
+                 (long long unsigned)totalTime);
         // ge throughput or latency
+        std::string metric = std::string(getBackendName(backend)) +
+                             "_d" + std::to_string(1 << logFifoSz) +
+                             "_w" + std::to_string(dataSz);
+        double res = 0;
         if(mode == Throughput) {
-            double throughput = double(test_num) / double(totalTime);
-            fprintf(stderr, "throughput %f data/cycle\n", throughput);
+            res = double(test_num) / double(totalTime);
+            logPrint("throughput %f data/cycle\n", res);
+            bench->record(metric + "_throughput", res, "data/cycle", true);
         }
         else {
-            double lat = double(totalTime) / double(test_num);
-            fprintf(stderr, "latency %f cycles\n", lat);
+            res = double(totalTime) / double(test_num);
+            logPrint("latency %f cycles\n", res);
+            bench->record(metric + "_latency", res, "cycles", false);
+        }
+        std::vector<std::vector<double> > &table = results[dataSz];
+        if(table.empty()) {
+            table.assign(LOG_MAX_FIFO_SZ + 1, std::vector<double>(backend_num, -1));
+        }
+        if(logFifoSz <= LOG_MAX_FIFO_SZ && backend < backend_num) {
+            table[logFifoSz][backend] = res;
         }
         fifo_num--;
         if(fifo_num == 0) {
+            printMatrix();
             sem_post(&sem);
         }
     }
 
-    virtual void err(uint8_t logFifoSz, uint64_t recvNum) {
-        fprintf(stderr, "ERROR: FIFO size %d err at %llu\n",
-                1 << logFifoSz, (long long unsigned)recvNum);
+    virtual void err(uint8_t backend, uint8_t batch, uint8_t logFifoSz, uint16_t dataSz,
+                     uint64_t recvNum) {
+        logPrint("ERROR: %s FIFO size %d data %d bits batch %d err at %llu\n",
+                 getBackendName(backend), 1 << logFifoSz, (int)dataSz, (int)batch,
+                 (long long unsigned)recvNum);
+        logFlush();
         exit(-1);
     }
 
     void waitDone() {
         sem_wait(&sem);
+        logFlush();
     }
 };
 
 void usage(char *prog) {
     fprintf(stderr, "Usage: %s TEST_NUM MODE DELAY\n", prog);
-    fprintf(stderr, "TEST_NUM > 0, MODE = Throughput or Latency\n");
+    fprintf(stderr, "TEST_NUM > 0, MODE = Throughput, Latency or Stream\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -105,17 +212,26 @@ int main(int argc, char *argv[]) {
     else if(strcmp(argv[2], "Latency") == 0) { 
         mode = Latency;
     }
+    else if(strcmp(argv[2], "Stream") == 0) {
+        mode = Stream;
+    }
     int fast_delay = atoi(argv[3]);
 
-    testInd = new SyncTestIndication(IfcNames_SyncTestIndicationH2S, test_num, mode);
+    Bench bench(mode == Throughput ? "SyncTest_throughput" :
+                mode == Latency ? "SyncTest_latency" : "SyncTest_stream");
+
+    testInd = new SyncTestIndication(IfcNames_SyncTestIndicationH2S, test_num, mode, &bench);
     testReq = new SyncTestRequestProxy(IfcNames_SyncTestRequestS2H);
 
     fprintf(stderr, "INFO: start: slow clk %d ns, fast clk %d ns, mode %s, num %llu, delay %d\n",
             USER_CLK_PERIOD, MainClockPeriod, argv[2], test_num, fast_delay);
-    testReq->start(test_num, mode, fast_delay);
-    testInd->waitDone();
+    for(int run = 0; run < bench.runNum(); run++) {
+        bench.beginRun(run);
+        testReq->start(test_num, mode, fast_delay);
+        testInd->waitDone();
+    }
 
     fprintf(stderr, "INFO: all done\n");
 
-    return 0;
+    return bench.finish();
 }
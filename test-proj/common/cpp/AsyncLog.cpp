@@ -0,0 +1,331 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "AsyncLog.h"
+#include "SpscQueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+// ring of a producer thread
+struct LogRing {
+    SpscQueue<LogEntry, 12> q;
+    std::atomic<uint64_t> committed; // by producer
+    std::atomic<uint64_t> written; // by drain thread
+    uint64_t popped; // drain thread only
+
+    LogRing() : committed(0), written(0), popped(0) {}
+};
+
+class AsyncLog {
+public:
+    AsyncLog();
+    ~AsyncLog();
+
+    LogEntry *alloc(const char *fmt);
+    void commit();
+    void flush();
+    uint64_t dropped() const { return drop_num.load(); }
+
+private:
+    bool block; // overflow policy
+    std::atomic<bool> stop;
+    std::atomic<uint64_t> next_seq;
+    std::atomic<uint64_t> drop_num;
+    uint64_t reported_drop_num; // drain thread only
+
+    std::mutex ring_mutex; // guard rings
+    std::vector<LogRing*> rings;
+    std::thread drain_thread;
+
+    LogRing *getRing();
+    void drain();
+    bool drainRings(std::string &out); // return false if nothing to write
+    void write(std::string &out);
+};
+
+AsyncLog logger;
+
+thread_local LogRing *thread_ring = 0;
+
+AsyncLog::AsyncLog() :
+    block(false),
+    stop(false),
+    next_seq(0),
+    drop_num(0),
+    reported_drop_num(0)
+{
+    const char *s = getenv("LOG_OVERFLOW");
+    if(s && strcmp(s, "block") == 0) {
+        block = true;
+    }
+    else if(s && strcmp(s, "drop") != 0) {
+        fprintf(stderr, "WARNING: unknown LOG_OVERFLOW %s, use drop\n", s);
+    }
+}
+
+AsyncLog::~AsyncLog() {
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        stop.store(true);
+    }
+    if(drain_thread.joinable()) {
+        drain_thread.join();
+    }
+    // rings are not freed, because other threads may still log (and drop)
+}
+
+LogRing *AsyncLog::getRing() {
+    if(!thread_ring) {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        if(stop.load()) {
+            return 0;
+        }
+        thread_ring = new LogRing;
+        rings.push_back(thread_ring);
+        if(!drain_thread.joinable()) {
+            drain_thread = std::thread(&AsyncLog::drain, this);
+        }
+    }
+    return thread_ring;
+}
+
+LogEntry *AsyncLog::alloc(const char *fmt) {
+    LogRing *r = getRing();
+    if(!r || stop.load(std::memory_order_relaxed)) {
+        drop_num.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    LogEntry *e = r->q.back();
+    while(!e && block && !stop.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+        e = r->q.back();
+    }
+    if(!e) {
+        drop_num.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    e->fmt = fmt;
+    e->seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+    e->arg_num = 0;
+    e->str_len = 0;
+    return e;
+}
+
+void AsyncLog::commit() {
+    thread_ring->q.push();
+    thread_ring->committed.fetch_add(1, std::memory_order_release);
+}
+
+void AsyncLog::flush() {
+    // wait for msgs committed so far in all rings
+    std::vector<std::pair<LogRing*, uint64_t> > target;
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        for(size_t i = 0; i < rings.size(); i++) {
+            target.push_back(std::make_pair(rings[i], rings[i]->committed.load()));
+        }
+    }
+    for(size_t i = 0; i < target.size(); i++) {
+        while(target[i].first->written.load(std::memory_order_acquire) < target[i].second) {
+            if(!drain_thread.joinable() || stop.load()) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+// format an entry, each conversion in fmt uses the type of its arg
+static void formatEntry(const LogEntry &e, std::string &out) {
+    const char *p = e.fmt;
+    int idx = 0;
+    while(*p) {
+        if(*p != '%') {
+            const char *q = strchr(p, '%');
+            size_t n = q ? q - p : strlen(p);
+            out.append(p, n);
+            p += n;
+            continue;
+        }
+        if(p[1] == '%') {
+            out.push_back('%');
+            p += 2;
+            continue;
+        }
+        // flags, width and precision are kept, length modifiers are dropped
+        char spec[32];
+        int n = 0;
+        spec[n++] = *p++;
+        while(*p && strchr("-+ #0", *p) && n < 8) {
+            spec[n++] = *p++;
+        }
+        while(isdigit(*p) && n < 16) {
+            spec[n++] = *p++;
+        }
+        if(*p == '.') {
+            spec[n++] = *p++;
+            while(isdigit(*p) && n < 24) {
+                spec[n++] = *p++;
+            }
+        }
+        while(*p && strchr("hlLqjzt", *p)) {
+            p++;
+        }
+        char conv = *p;
+        if(!conv) {
+            break;
+        }
+        p++;
+        if(idx >= e.arg_num) {
+            out.append("(?)");
+            continue;
+        }
+        LogArgType t = LogArgType(e.arg_type[idx]);
+        int64_t ival = t == LogDouble ? int64_t(e.arg[idx].d) : e.arg[idx].i;
+        double dval = t == LogDouble ? e.arg[idx].d :
+                      t == LogInt ? double(e.arg[idx].i) : double(e.arg[idx].u);
+        char buf[256];
+        buf[0] = 0;
+        switch(conv) {
+            case 'd': case 'i':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = 'd'; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, (long long)ival);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, (unsigned long long)ival);
+                break;
+            case 'c':
+                spec[n++] = 'c'; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, int(ival));
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[n++] = conv; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, dval);
+                break;
+            case 's':
+                spec[n++] = 's'; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, t == LogStr ? e.str + e.arg[idx].u : "(?)");
+                break;
+            case 'p':
+                spec[n++] = 'p'; spec[n] = 0;
+                snprintf(buf, sizeof(buf), spec, e.arg[idx].p);
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "(?)");
+        }
+        out.append(buf);
+        idx++;
+    }
+}
+
+// format the oldest msgs of all rings
+bool AsyncLog::drainRings(std::string &out) {
+    std::vector<LogRing*> cur;
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        cur = rings;
+    }
+    bool any = false;
+    while(out.size() < (64 << 10)) {
+        LogRing *oldest = 0;
+        const LogEntry *oldest_e = 0;
+        for(size_t i = 0; i < cur.size(); i++) {
+            const LogEntry *e = cur[i]->q.front();
+            if(e && (!oldest_e || e->seq < oldest_e->seq)) {
+                oldest = cur[i];
+                oldest_e = e;
+            }
+        }
+        if(!oldest) {
+            break;
+        }
+        formatEntry(*oldest_e, out);
+        oldest->q.pop();
+        oldest->popped++;
+        any = true;
+    }
+    return any;
+}
+
+void AsyncLog::write(std::string &out) {
+    if(!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stderr);
+        fflush(stderr);
+        out.clear();
+    }
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    for(size_t i = 0; i < rings.size(); i++) {
+        rings[i]->written.store(rings[i]->popped, std::memory_order_release);
+    }
+}
+
+void AsyncLog::drain() {
+    std::string out;
+    while(true) {
+        bool stopping = stop.load();
+        bool any = drainRings(out);
+        uint64_t drop = drop_num.load(std::memory_order_relaxed);
+        if(drop != reported_drop_num) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "WARNING: log ring full, dropped %llu messages "
+                     "(%llu in total)\n", (long long unsigned)(drop - reported_drop_num),
+                     (long long unsigned)drop);
+            out.append(buf);
+            reported_drop_num = drop;
+        }
+        write(out);
+        if(!any) {
+            if(stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+}
+
+LogEntry *logAlloc(const char *fmt) {
+    return logger.alloc(fmt);
+}
+
+void logCommit() {
+    logger.commit();
+}
+
+void logFlush() {
+    logger.flush();
+}
+
+uint64_t logDropped() {
+    return logger.dropped();
+}
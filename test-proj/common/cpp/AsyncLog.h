@@ -0,0 +1,152 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+// Non-blocking logger for indication callbacks of test hosts.
+//
+// logPrint(fmt, args...) takes printf-style format and args, but only copies
+// them into a binary entry of a per-thread lock-free ring. A background drain
+// thread formats the entries (in the order they are logged across threads)
+// and writes them to stderr, so slow I/O does not stall the portal indication
+// thread. fmt must be a string literal (it is formatted later); string args
+// are copied into the entry (truncated to log_str_bytes in total). Length
+// modifiers in fmt are ignored, each conversion uses the type of its arg.
+//
+// When a ring is full, the overflow policy is selected by environment
+// variable LOG_OVERFLOW:
+//   drop   drop the new message and count it (default)
+//   block  wait until the drain thread makes space
+// Dropped messages are reported by the drain thread, and by logDropped().
+//
+// logFlush() waits until all messages logged so far are written, it should be
+// called before printing to stderr directly (e.g., after waiting for done).
+
+const int log_max_args = 10;
+const int log_str_bytes = 96;
+
+enum LogArgType {
+    LogInt,
+    LogUint,
+    LogDouble,
+    LogStr, // offset in str
+    LogPtr
+};
+
+struct LogEntry {
+    const char *fmt;
+    uint64_t seq; // global order
+    uint8_t arg_num;
+    uint8_t str_len;
+    uint8_t arg_type[log_max_args];
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+    } arg[log_max_args];
+    char str[log_str_bytes];
+};
+
+// get a free entry in the ring of current thread (NULL if dropped), and commit
+// it after it is filled
+LogEntry *logAlloc(const char *fmt);
+void logCommit();
+
+void logFlush();
+uint64_t logDropped();
+
+// pack args into entry
+inline void logPackArgs(LogEntry &) {}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+logPackArg(LogEntry &e, T x) {
+    if(std::is_signed<T>::value || std::is_enum<T>::value) {
+        e.arg_type[e.arg_num] = LogInt;
+        e.arg[e.arg_num].i = int64_t(x);
+    }
+    else {
+        e.arg_type[e.arg_num] = LogUint;
+        e.arg[e.arg_num].u = uint64_t(x);
+    }
+}
+
+inline void logPackArg(LogEntry &e, double x) {
+    e.arg_type[e.arg_num] = LogDouble;
+    e.arg[e.arg_num].d = x;
+}
+
+inline void logPackArg(LogEntry &e, const char *s) {
+    size_t n = s ? strlen(s) : 0;
+    size_t space = log_str_bytes - e.str_len;
+    if(n >= space) {
+        n = space > 0 ? space - 1 : 0;
+    }
+    e.arg_type[e.arg_num] = LogStr;
+    e.arg[e.arg_num].u = e.str_len;
+    if(space > 0) {
+        memcpy(e.str + e.str_len, s, n);
+        e.str[e.str_len + n] = 0;
+        e.str_len += n + 1;
+    }
+    else {
+        e.arg[e.arg_num].u = log_str_bytes - 1; // empty string
+    }
+}
+
+inline void logPackArg(LogEntry &e, char *s) {
+    logPackArg(e, (const char*)s);
+}
+
+inline void logPackArg(LogEntry &e, const std::string &s) {
+    logPackArg(e, s.c_str());
+}
+
+inline void logPackArg(LogEntry &e, const void *p) {
+    e.arg_type[e.arg_num] = LogPtr;
+    e.arg[e.arg_num].p = p;
+}
+
+template<typename T, typename... Args>
+inline void logPackArgs(LogEntry &e, const T &x, const Args&... args) {
+    if(e.arg_num < log_max_args) {
+        logPackArg(e, x);
+        e.arg_num++;
+    }
+    logPackArgs(e, args...);
+}
+
+template<typename... Args>
+inline void logPrint(const char *fmt, const Args&... args) {
+    LogEntry *e = logAlloc(fmt);
+    if(e) {
+        logPackArgs(*e, args...);
+        logCommit();
+    }
+}
@@ -0,0 +1,239 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// two-sided 95% quantile of Student's t distribution, indexed by degrees of
+// freedom (1 to 30), larger dof uses the normal quantile
+static const double t_quantile[] = {
+    0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+static const int t_quantile_num = sizeof(t_quantile) / sizeof(t_quantile[0]);
+
+static int getEnvInt(const char *var, int default_val) {
+    const char *s = getenv(var);
+    return s ? atoi(s) : default_val;
+}
+
+Bench::Bench(const char *bench_name, bool repeatable) :
+    name(bench_name),
+    rep_num(1),
+    warmup_num(0),
+    cur_run(0),
+    threshold(0.05),
+    json_file(getenv("BENCH_JSON")),
+    csv_file(getenv("BENCH_CSV")),
+    baseline_file(getenv("BENCH_BASELINE"))
+{
+    if(repeatable) {
+        rep_num = getEnvInt("BENCH_REPS", 1);
+        warmup_num = getEnvInt("BENCH_WARMUP", 0);
+        if(rep_num < 1) {
+            rep_num = 1;
+        }
+        if(warmup_num < 0) {
+            warmup_num = 0;
+        }
+    }
+    else if(getenv("BENCH_REPS") || getenv("BENCH_WARMUP")) {
+        fprintf(stderr, "WARNING: bench %s runs only once per program, "
+                "BENCH_REPS and BENCH_WARMUP are ignored\n", name.c_str());
+    }
+    const char *s = getenv("BENCH_THRESHOLD");
+    if(s) {
+        threshold = atof(s);
+    }
+}
+
+void Bench::beginRun(int i) {
+    cur_run = i;
+    if(runNum() > 1) {
+        fprintf(stderr, "INFO: bench %s: %s run %d/%d\n", name.c_str(),
+                isWarmup() ? "warm-up" : "measured",
+                isWarmup() ? i + 1 : i - warmup_num + 1,
+                isWarmup() ? warmup_num : rep_num);
+    }
+}
+
+void Bench::record(const std::string &metric, double value,
+                   const char *unit, bool higher_better) {
+    if(isWarmup()) {
+        return;
+    }
+    std::map<std::string, Metric>::iterator it = metrics.find(metric);
+    if(it == metrics.end()) {
+        Metric m;
+        m.unit = unit;
+        m.higher_better = higher_better;
+        it = metrics.insert(std::make_pair(metric, m)).first;
+        order.push_back(metric);
+    }
+    it->second.samples.push_back(value);
+}
+
+void Bench::computeStats(Metric &m) {
+    size_t n = m.samples.size();
+    double sum = 0;
+    m.min = m.samples[0];
+    m.max = m.samples[0];
+    for(size_t i = 0; i < n; i++) {
+        sum += m.samples[i];
+        m.min = m.samples[i] < m.min ? m.samples[i] : m.min;
+        m.max = m.samples[i] > m.max ? m.samples[i] : m.max;
+    }
+    m.mean = sum / n;
+    m.stddev = 0;
+    m.ci = 0;
+    if(n > 1) {
+        double sq = 0;
+        for(size_t i = 0; i < n; i++) {
+            sq += (m.samples[i] - m.mean) * (m.samples[i] - m.mean);
+        }
+        m.stddev = sqrt(sq / (n - 1));
+        double t = n - 1 < t_quantile_num ? t_quantile[n - 1] : 1.960;
+        m.ci = t * m.stddev / sqrt(double(n));
+    }
+}
+
+void Bench::writeJson() {
+    FILE *fp = fopen(json_file, "w");
+    if(!fp) {
+        fprintf(stderr, "ERROR: fail to open bench JSON file %s\n", json_file);
+        return;
+    }
+    fprintf(fp, "{\n  \"bench\": \"%s\",\n  \"reps\": %d,\n  \"warmup\": %d,\n"
+            "  \"metrics\": [", name.c_str(), rep_num, warmup_num);
+    for(size_t i = 0; i < order.size(); i++) {
+        const Metric &m = metrics[order[i]];
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", "
+                "\"higher_better\": %s, \"n\": %zu, \"mean\": %.9g, "
+                "\"stddev\": %.9g, \"min\": %.9g, \"max\": %.9g, "
+                "\"ci95\": %.9g, \"samples\": [",
+                i == 0 ? "" : ",", order[i].c_str(), m.unit.c_str(),
+                m.higher_better ? "true" : "false", m.samples.size(),
+                m.mean, m.stddev, m.min, m.max, m.ci);
+        for(size_t k = 0; k < m.samples.size(); k++) {
+            fprintf(fp, "%s%.9g", k == 0 ? "" : ", ", m.samples[k]);
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+}
+
+void Bench::writeCsv() {
+    FILE *fp = fopen(csv_file, "w");
+    if(!fp) {
+        fprintf(stderr, "ERROR: fail to open bench CSV file %s\n", csv_file);
+        return;
+    }
+    fprintf(fp, "bench,metric,unit,higher_better,n,mean,stddev,min,max,ci95\n");
+    for(size_t i = 0; i < order.size(); i++) {
+        const Metric &m = metrics[order[i]];
+        fprintf(fp, "%s,%s,%s,%d,%zu,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                name.c_str(), order[i].c_str(), m.unit.c_str(),
+                m.higher_better ? 1 : 0, m.samples.size(),
+                m.mean, m.stddev, m.min, m.max, m.ci);
+    }
+    fclose(fp);
+}
+
+int Bench::checkBaseline() {
+    FILE *fp = fopen(baseline_file, "r");
+    if(!fp) {
+        fprintf(stderr, "ERROR: fail to open bench baseline file %s\n",
+                baseline_file);
+        return 1;
+    }
+    int regress_num = 0;
+    int check_num = 0;
+    char line[1024];
+    while(fgets(line, sizeof(line), fp)) {
+        // bench,metric,unit,higher_better,n,mean,...
+        std::vector<std::string> fields;
+        char *save = 0;
+        for(char *f = strtok_r(line, ",\r\n", &save); f;
+            f = strtok_r(0, ",\r\n", &save)) {
+            fields.push_back(f);
+        }
+        if(fields.size() < 6 || fields[0] != name) {
+            continue; // header or other bench
+        }
+        std::map<std::string, Metric>::iterator it = metrics.find(fields[1]);
+        if(it == metrics.end()) {
+            fprintf(stderr, "WARNING: bench %s: baseline metric %s not measured\n",
+                    name.c_str(), fields[1].c_str());
+            continue;
+        }
+        const Metric &m = it->second;
+        double base = atof(fields[5].c_str());
+        if(base == 0) {
+            continue;
+        }
+        // positive diff means worse
+        double diff = (m.higher_better ? base - m.mean : m.mean - base) / fabs(base);
+        bool regress = diff > threshold;
+        fprintf(stderr, "%s: bench %s: %s mean %g, baseline %g, %+.2f%% %s\n",
+                regress ? "ERROR" : "INFO", name.c_str(), fields[1].c_str(),
+                m.mean, base, -diff * 100, regress ? "REGRESSION" : "ok");
+        check_num++;
+        if(regress) {
+            regress_num++;
+        }
+    }
+    fclose(fp);
+    fprintf(stderr, "INFO: bench %s: %d metrics checked against baseline, "
+            "%d regressions (threshold %g%%)\n",
+            name.c_str(), check_num, regress_num, threshold * 100);
+    return regress_num > 0 ? 1 : 0;
+}
+
+int Bench::finish() {
+    if(order.empty()) {
+        return 0;
+    }
+    fprintf(stderr, "INFO: bench %s: %d runs, %d warm-up\n",
+            name.c_str(), rep_num, warmup_num);
+    fprintf(stderr, "%-32s %14s %12s %14s %14s %14s  %s\n", "metric",
+            "mean", "stddev", "min", "max", "95% CI", "unit");
+    for(size_t i = 0; i < order.size(); i++) {
+        Metric &m = metrics[order[i]];
+        computeStats(m);
+        fprintf(stderr, "%-32s %14.4f %12.4f %14.4f %14.4f %14.4f  %s\n",
+                order[i].c_str(), m.mean, m.stddev, m.min, m.max, m.ci,
+                m.unit.c_str());
+    }
+    if(json_file) {
+        writeJson();
+    }
+    if(csv_file) {
+        writeCsv();
+    }
+    return baseline_file ? checkBaseline() : 0;
+}
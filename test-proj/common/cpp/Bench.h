@@ -0,0 +1,99 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// Benchmark harness shared by the host programs of test projects.
+//
+// A host runs its test runNum() times. The first warmup() runs are warm-up,
+// and samples recorded in them are dropped. After all runs, finish() prints
+// mean/stddev/min/max and 95% confidence interval of each metric, writes them
+// to JSON/CSV files, and compares them against a baseline CSV (written by an
+// earlier run with BENCH_CSV).
+//
+// Configs are read from environment variables, so the command line of each
+// host is not changed:
+//   BENCH_REPS       number of measured runs (default 1)
+//   BENCH_WARMUP     number of warm-up runs (default 0)
+//   BENCH_JSON       output JSON file
+//   BENCH_CSV        output CSV file
+//   BENCH_BASELINE   baseline CSV file
+//   BENCH_THRESHOLD  max allowed relative regression of mean (default 0.05)
+class Bench {
+public:
+    // repeatable is false if the test can run only once per program, then
+    // BENCH_REPS and BENCH_WARMUP are ignored
+    Bench(const char *bench_name, bool repeatable = true);
+
+    int runNum() const { return warmup_num + rep_num; }
+    int warmup() const { return warmup_num; }
+
+    // start run i (0 <= i < runNum())
+    void beginRun(int i);
+    bool isWarmup() const { return cur_run < warmup_num; }
+
+    // record a sample in current run, higher_better tells the direction of
+    // regression
+    void record(const std::string &metric, double value,
+                const char *unit, bool higher_better);
+
+    // report all metrics, return non-zero if any metric regresses from
+    // baseline (or baseline cannot be read)
+    int finish();
+
+private:
+    struct Metric {
+        std::string unit;
+        bool higher_better;
+        std::vector<double> samples;
+        // stats
+        double mean;
+        double stddev;
+        double min;
+        double max;
+        double ci; // half width of 95% confidence interval
+    };
+
+    std::string name;
+    int rep_num;
+    int warmup_num;
+    int cur_run;
+    double threshold;
+    const char *json_file;
+    const char *csv_file;
+    const char *baseline_file;
+    // metrics in the order of first record
+    std::vector<std::string> order;
+    std::map<std::string, Metric> metrics;
+
+    void computeStats(Metric &m);
+    void writeJson();
+    void writeCsv();
+    int checkBaseline();
+};
+
@@ -0,0 +1,86 @@
+
+// Copyright (c) 2017 Massachusetts Institute of Technology
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// lock-free queue with a single producer and a single consumer
+template<typename T, int log_size>
+class SpscQueue {
+private:
+    static const uint64_t size = 1ULL << log_size;
+    T buf[size];
+    std::atomic<uint64_t> enq_ptr;
+    std::atomic<uint64_t> deq_ptr;
+
+public:
+    SpscQueue() : enq_ptr(0), deq_ptr(0) {}
+
+    bool enq(const T &x) {
+        uint64_t e = enq_ptr.load(std::memory_order_relaxed);
+        if(e - deq_ptr.load(std::memory_order_acquire) == size) {
+            return false; // full
+        }
+        buf[e & (size - 1)] = x;
+        enq_ptr.store(e + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool deq(T &x) {
+        uint64_t d = deq_ptr.load(std::memory_order_relaxed);
+        if(d == enq_ptr.load(std::memory_order_acquire)) {
+            return false; // empty
+        }
+        x = buf[d & (size - 1)];
+        deq_ptr.store(d + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer: fill the slot in place, then commit with push
+    T *back() {
+        uint64_t e = enq_ptr.load(std::memory_order_relaxed);
+        if(e - deq_ptr.load(std::memory_order_acquire) == size) {
+            return 0; // full
+        }
+        return &buf[e & (size - 1)];
+    }
+
+    void push() {
+        enq_ptr.store(enq_ptr.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer: read the oldest in place, then release with pop
+    const T *front() {
+        uint64_t d = deq_ptr.load(std::memory_order_relaxed);
+        if(d == enq_ptr.load(std::memory_order_acquire)) {
+            return 0; // empty
+        }
+        return &buf[d & (size - 1)];
+    }
+
+    void pop() {
+        deq_ptr.store(deq_ptr.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};